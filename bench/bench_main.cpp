@@ -0,0 +1,278 @@
+// Host benchmarks of the web and provisioning layer and of the effects.
+// Built and checked against thresholds.json by tools/run_benchmarks.py.
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <chrono>
+#include <vector>
+#include "host_alloc.h"
+#include "portal_material.h"
+#include "home_material.h"
+#include "wifi_scan.h"
+#include "device_state.h"
+#include "credential_store.h"
+#include "frame_buffer.h"
+#include "effect_vm.h"
+#include "native_effects.h"
+#include "segment_renderer.h"
+#include "color_tables.h"
+#include "color_float.h"
+
+#define BENCH_MIN_MICROS 20000
+#define BENCH_MIN_ITERATIONS 10
+#define BENCH_CHUNK_SIZE 1436  // Typical first chunk of an async response, one TCP segment
+#define BENCH_PIXELS 300
+
+HardwareSerial Serial;
+WiFiClass WiFi;
+
+struct BenchResult {
+    const char* name;
+    double micros;          // Per call
+    double allocations;     // Per call
+    size_t peakBytes;       // Heap in use by one call at its peak
+    unsigned long iterations;
+};
+
+static std::vector<BenchResult> results;
+static volatile size_t sink;  // Keeps the results from being optimized away
+
+// Body returns a size so the work it does is observable
+template <typename F>
+static void bench(const char* name, F body) {
+    sink += body();  // Warm up
+
+    const hostalloc::Stats& stats = hostalloc::stats();
+    unsigned long allocationsBefore = stats.allocations;
+    size_t liveBefore = stats.liveBytes;
+    hostalloc::resetPeak();
+
+    unsigned long iterations = 0;
+    unsigned long start = micros();
+    unsigned long elapsed;
+    do {
+        sink += body();
+        iterations++;
+        elapsed = micros() - start;
+    } while (elapsed < BENCH_MIN_MICROS || iterations < BENCH_MIN_ITERATIONS);
+
+    BenchResult result;
+    result.name = name;
+    result.micros = (double)elapsed / iterations;
+    result.allocations = (double)(stats.allocations - allocationsBefore) / iterations;
+    result.peakBytes = stats.peakBytes - liveBefore;
+    result.iterations = iterations;
+    results.push_back(result);
+}
+
+static void benchPages() {
+    bench("portal_html", [] { return getPortalHTML().length(); });
+    bench("home_html", [] { return getHomeHTML().length(); });
+}
+
+static void benchMaterialHelpers() {
+    bench("material_get_header", [] { return MaterialPage::getHeader("Smart Home Light").length(); });
+    bench("material_get_inline_header", [] { return MaterialPage::getInlineHeader("WiFi Setup").length(); });
+    bench("material_get_app_bar", [] { return MaterialPage::getAppBar("Smart Home Light", "WiFi Connected").length(); });
+    bench("material_start_card", [] { return MaterialPage::startCard("Configuration").length(); });
+    bench("material_end_card", [] { return MaterialPage::endCard().length(); });
+    bench("material_get_footer", [] { return MaterialPage::getFooter().length(); });
+    bench("material_form_field", [] {
+        return MaterialPage::formField("Name", MaterialPage::textInput("name", "name", true)).length();
+    });
+    bench("material_text_input", [] { return MaterialPage::textInput("name", "name", true, "Living room").length(); });
+    bench("material_password_input", [] { return MaterialPage::passwordInput("password", "password").length(); });
+    bench("material_number_input", [] { return MaterialPage::numberInput("level", "level", 0, 100, 50, true).length(); });
+    bench("material_button", [] { return MaterialPage::button("Save", "submit", "saveBtn").length(); });
+    bench("material_status_message", [] { return MaterialPage::statusMessage("status").length(); });
+    bench("material_list_item", [] {
+        return MaterialPage::listItem("Device", "Connected", "<span class='chip'>Online</span>").length();
+    });
+}
+
+static void benchScan() {
+    static const int NETWORKS[] = { 1, 10, 30 };
+    static const char* const NAMES[] = { "scan_json_1", "scan_json_10", "scan_json_30" };
+
+    for (int i = 0; i < 3; i++) {
+        WiFi.setScanResults(NETWORKS[i]);
+        bench(NAMES[i], [] {
+            static char buffer[4096];
+            JsonWriter json(buffer, sizeof(buffer));
+            writeScanJSON(json, *copyScanResults(WiFi.scanNetworks()));
+            return json.written();
+        });
+    }
+
+    // Whole response as sent by /scan, one copy of the records and the
+    // array rendered once per chunk
+    bench("scan_json_30_chunked", [] {
+        static char buffer[BENCH_CHUNK_SIZE];
+        ScanResults networks = copyScanResults(WiFi.scanNetworks());
+        size_t index = 0;
+        while (true) {
+            JsonWriter json(buffer, sizeof(buffer), index);
+            writeScanJSON(json, *networks);
+            if (json.written() == 0) break;
+            index += json.written();
+        }
+        return index;
+    });
+}
+
+static void benchState() {
+    DeviceState state = {};
+    state.light = { "ambient", false, 2, 300, 50, 123456, 1800, 350 };
+    state.wifi.connected = true;
+    strcpy(state.wifi.ssid, "HomeNetwork-01");
+    memcpy(state.wifi.ip, "\xc0\xa8\x01\x32", 4);
+    state.wifi.rssi = -58;
+    state.system = { 86400, 181000, 152000, 110000, 0, 3, 12000, 17 };
+    state.sync.role = SYNC_MASTER;
+    state.sync.id = state.sync.master = 0x1a2b3c4d;
+    state.sync.synced = true;
+    state.sync.peerCount = 3;
+    for (uint8_t i = 0; i < state.sync.peerCount; i++) {
+        state.sync.peers[i] = { 0x1a2b3c50u + i, -120 + 80 * i, 1800 };
+    }
+
+    bench("state_json", [&] {
+        static char buffer[STATE_JSON_SIZE];
+        JsonWriter json(buffer, sizeof(buffer));
+        writeStateJSON(json, state);
+        return json.written();
+    });
+}
+
+static void benchCredentials() {
+    String ssid = "HomeNetwork-01";
+    String password = "correct horse battery staple";
+
+    bench("credentials_save", [&] {
+        saveWifiCredentials(ssid, password);
+        return (size_t)1;
+    });
+    bench("credentials_load", [] {
+        String loadedSsid, loadedPassword;
+        loadWifiCredentials(loadedSsid, loadedPassword);
+        return (size_t)(loadedSsid.length() + loadedPassword.length());
+    });
+}
+
+// One frame of the ambient wave, natively and as script, see docs/EFFECT_SCRIPTS.md
+static void benchEffects() {
+    static RgbwFrameBuffer frame(BENCH_PIXELS);
+    frame.begin();
+
+    static AmbientWaveEffect native;
+    static unsigned long ms = 0;
+    bench("effect_native_300", [] {
+        native.render(frame, 0, BENCH_PIXELS, ms += 20);
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).R;
+    });
+
+    static ScriptEffect script;
+    script.load(AMBIENT_WAVE_PROGRAM, AMBIENT_WAVE_PROGRAM_SIZE);
+    bench("effect_script_300", [] {
+        script.render(frame, 0, BENCH_PIXELS, ms += 20);
+        return (size_t)script.getLastInstructions();
+    });
+}
+
+// The color conversions the firmware runs, with the tables and with the
+// float math they replace, see docs/LED_OUTPUT.md
+static void benchColor() {
+    static RgbwFrameBuffer frame(BENCH_PIXELS);
+    frame.begin();
+    static int n = 0;
+
+    // rgb script instruction, a gradient so every pixel needs its own conversion
+    bench("color_rgb_float_300", [] {
+        n++;
+        for (uint16_t i = 0; i < BENCH_PIXELS; i++) {
+            float r = (float)i / BENCH_PIXELS;
+            frame.setPixelColor(i, LedColorFloat::linearToRgbw(r, 0.6f * r + 0.002f * (n & 63), 0.3f));
+        }
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).W;
+    });
+    bench("color_rgb_table_300", [] {
+        n++;
+        for (uint16_t i = 0; i < BENCH_PIXELS; i++) {
+            uint16_t r = (uint32_t)65535 * i / BENCH_PIXELS;
+            frame.setPixelColor(i, LedColor::linearToRgbw(r, r * 3 / 5 + 131 * (n & 63), 19661));
+        }
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).W;
+    });
+
+    // ColorTemperatureEffect, one conversion per frame and a fill
+    bench("color_temperature_float_300", [] {
+        n++;
+        frame.fill(0, BENCH_PIXELS, LedColorFloat::kelvinToRgbw(2700.0f + (n & 63), 0.5f));
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).W;
+    });
+    static ColorTemperatureEffect temperature;
+    bench("color_temperature_table_300", [] {
+        n++;
+        temperature.setKelvin(2700 + (n & 63));
+        temperature.render(frame, 0, BENCH_PIXELS, 0);
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).W;
+    });
+}
+
+// Ambient wave script on 4 segments of 300 LEDs, on one and on two threads
+// standing in for the cores, see docs/SEGMENTS.md
+static void benchSegments() {
+    static RgbwFrameBuffer frame(BENCH_PIXELS);
+    frame.begin();
+
+    static ScriptEffect scripts[4];
+    static SegmentRenderer renderer(BENCH_PIXELS);
+    renderer.begin();
+    for (uint8_t i = 0; i < 4; i++) {
+        scripts[i].load(AMBIENT_WAVE_PROGRAM, AMBIENT_WAVE_PROGRAM_SIZE);
+        renderer.addSegment(i * BENCH_PIXELS / 4, BENCH_PIXELS / 4, &scripts[i]);
+    }
+
+    static unsigned long ms = 0;
+    renderer.setParallel(false);
+    bench("segments_4_1core", [] {
+        renderer.render(frame, ms += 20);
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).R;
+    });
+    renderer.setParallel(true);
+    bench("segments_4_2cores", [] {
+        renderer.render(frame, ms += 20);
+        return (size_t)frame.getPixelColor(BENCH_PIXELS / 2).R;
+    });
+
+    // Reading spot added on top, the only segment that is composed
+    static ScriptEffect spot;
+    spot.load(AMBIENT_WAVE_PROGRAM, AMBIENT_WAVE_PROGRAM_SIZE);
+    renderer.addSegment(100, 60, &spot, BLEND_ADD);
+    bench("segments_4_spot_2cores", [] {
+        renderer.render(frame, ms += 20);
+        return (size_t)renderer.getStats().composeMicros;
+    });
+}
+
+int main() {
+    benchPages();
+    benchMaterialHelpers();
+    benchScan();
+    benchState();
+    benchCredentials();
+    benchEffects();
+    benchColor();
+    benchSegments();
+
+    printf("{\n  \"benchmarks\": [\n");
+    for (size_t i = 0; i < results.size(); i++) {
+        const BenchResult& r = results[i];
+        printf("    {\"name\": \"%s\", \"time_us\": %.3f, \"allocations\": %.2f, "
+               "\"peak_bytes\": %zu, \"iterations\": %lu}%s\n",
+               r.name, r.micros, r.allocations, r.peakBytes, r.iterations,
+               i + 1 < results.size() ? "," : "");
+    }
+    printf("  ]\n}\n");
+    return 0;
+}
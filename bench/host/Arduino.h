@@ -0,0 +1,49 @@
+#ifndef ARDUINO_H
+#define ARDUINO_H
+
+// Minimal Arduino API for building the web and provisioning code on the
+// host, see bench/README.md
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <thread>
+#include "WString.h"
+
+#define PROGMEM
+
+inline unsigned long micros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+inline unsigned long millis() {
+    return micros() / 1000;
+}
+
+inline void delay(unsigned long ms) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+inline void delayMicroseconds(unsigned int us) {
+    std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
+
+class HardwareSerial {
+public:
+    void begin(unsigned long) {}
+    template <typename... T>
+    int printf(const char* format, T... args) { return ::printf(format, args...); }
+    void print(const char* text) { fputs(text, stdout); }
+    void print(const String& text) { print(text.c_str()); }
+    void println(const char* text = "") { puts(text); }
+    void println(const String& text) { println(text.c_str()); }
+    int available() { return 0; }
+    int read() { return -1; }
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef NEOPIXELBUS_H
+#define NEOPIXELBUS_H
+
+// RgbwColor of NeoPixelBus, enough to build the framebuffers and effects
+// on the host. The bus classes are not needed there.
+
+#include <cstdint>
+
+struct RgbwColor {
+    RgbwColor() : R(0), G(0), B(0), W(0) {}
+    RgbwColor(uint8_t r, uint8_t g, uint8_t b, uint8_t w) : R(r), G(g), B(b), W(w) {}
+    // Like NeoPixelBus: white only
+    explicit RgbwColor(uint8_t brightness) : R(0), G(0), B(0), W(brightness) {}
+
+    uint8_t R;
+    uint8_t G;
+    uint8_t B;
+    uint8_t W;
+};
+
+#endif
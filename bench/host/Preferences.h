@@ -0,0 +1,115 @@
+#ifndef PREFERENCES_H
+#define PREFERENCES_H
+
+#include <Arduino.h>
+
+#define PREFERENCES_ENTRIES 16
+#define PREFERENCES_KEY_SIZE 16
+#define PREFERENCES_VALUE_SIZE 256
+
+// In-memory Preferences for the host build. Entries live in static storage,
+// so the fake itself never allocates and only the caller's Strings count.
+class Preferences {
+public:
+    Preferences() : space(nullptr), readOnly(true) {}
+
+    bool begin(const char* name, bool isReadOnly = false) {
+        space = name;
+        readOnly = isReadOnly;
+        return true;
+    }
+
+    void end() {
+        space = nullptr;
+    }
+
+    bool clear() {
+        if (!space || readOnly) return false;
+        for (Entry& entry : entries()) {
+            if (entry.used && strcmp(entry.space, space) == 0) entry.used = false;
+        }
+        return true;
+    }
+
+    bool remove(const char* key) {
+        Entry* entry = find(key);
+        if (!entry || readOnly) return false;
+        entry->used = false;
+        return true;
+    }
+
+    size_t putBytes(const char* key, const void* value, size_t length) {
+        if (!space || readOnly || length > PREFERENCES_VALUE_SIZE) return 0;
+        Entry* entry = find(key);
+        if (!entry) entry = add(key);
+        if (!entry) return 0;
+        memcpy(entry->value, value, length);
+        entry->length = length;
+        return length;
+    }
+
+    size_t getBytesLength(const char* key) {
+        Entry* entry = find(key);
+        return entry ? entry->length : 0;
+    }
+
+    size_t getBytes(const char* key, void* buffer, size_t maxLength) {
+        Entry* entry = find(key);
+        if (!entry || entry->length > maxLength) return 0;
+        memcpy(buffer, entry->value, entry->length);
+        return entry->length;
+    }
+
+    size_t putString(const char* key, const String& value) {
+        return putBytes(key, value.c_str(), value.length() + 1) ? value.length() : 0;
+    }
+
+    String getString(const char* key, const String& defaultValue = String()) {
+        Entry* entry = find(key);
+        if (!entry) return defaultValue;
+        return String((const char*)entry->value);
+    }
+
+private:
+    struct Entry {
+        bool used;
+        char space[PREFERENCES_KEY_SIZE];
+        char key[PREFERENCES_KEY_SIZE];
+        uint8_t value[PREFERENCES_VALUE_SIZE];
+        size_t length;
+    };
+
+    const char* space;
+    bool readOnly;
+
+    static Entry (&entries())[PREFERENCES_ENTRIES] {
+        static Entry storage[PREFERENCES_ENTRIES];
+        return storage;
+    }
+
+    Entry* find(const char* key) {
+        if (!space) return nullptr;
+        for (Entry& entry : entries()) {
+            if (entry.used && strcmp(entry.space, space) == 0 && strcmp(entry.key, key) == 0) {
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+
+    Entry* add(const char* key) {
+        for (Entry& entry : entries()) {
+            if (!entry.used) {
+                entry.used = true;
+                strncpy(entry.space, space, PREFERENCES_KEY_SIZE - 1);
+                entry.space[PREFERENCES_KEY_SIZE - 1] = '\0';
+                strncpy(entry.key, key, PREFERENCES_KEY_SIZE - 1);
+                entry.key[PREFERENCES_KEY_SIZE - 1] = '\0';
+                return &entry;
+            }
+        }
+        return nullptr;
+    }
+};
+
+#endif
@@ -0,0 +1,208 @@
+#ifndef WSTRING_H
+#define WSTRING_H
+
+#include <cstdio>
+#include <cstring>
+#include "host_alloc.h"
+
+#define HEX 16
+#define DEC 10
+
+// Host stand-in for the Arduino String of the ESP32 core. It follows the
+// core's buffer policy, so allocation counts match the device: strings up
+// to 10 characters live inline, longer ones grow to the next multiple of
+// 16 bytes, and '+' chains append to one StringSumHelper temporary.
+class StringSumHelper;
+
+class String {
+public:
+    String() { init(); }
+    String(const char* cstr) { init(); if (cstr) copy(cstr, strlen(cstr)); }
+    String(const String& value) { init(); copy(value.c_str(), value.len); }
+    String(String&& value) noexcept { init(); move(value); }
+    explicit String(char c) { init(); copy(&c, 1); }
+    explicit String(int value, unsigned char base = 10) { init(); signedNumber(value, base); }
+    explicit String(unsigned int value, unsigned char base = 10) { init(); unsignedNumber(value, base); }
+    explicit String(long value, unsigned char base = 10) { init(); signedNumber(value, base); }
+    explicit String(unsigned long value, unsigned char base = 10) { init(); unsignedNumber(value, base); }
+    ~String() { if (!sso) hostalloc::release(heap); }
+
+    String& operator=(const String& rhs) { if (this != &rhs) copy(rhs.c_str(), rhs.len); return *this; }
+    String& operator=(String&& rhs) noexcept { if (this != &rhs) move(rhs); return *this; }
+    String& operator=(const char* cstr) { if (cstr) copy(cstr, strlen(cstr)); else len = 0; return *this; }
+
+    bool reserve(unsigned int size) {
+        if (size <= capacity) return true;
+        return changeBuffer(size);
+    }
+
+    bool concat(const char* cstr, unsigned int length) {
+        if (!cstr) return false;
+        if (length == 0) return true;
+        if (!reserve(len + length)) return false;
+        memmove(buffer() + len, cstr, length);
+        len += length;
+        buffer()[len] = '\0';
+        return true;
+    }
+    bool concat(const String& s) { return concat(s.c_str(), s.len); }
+    bool concat(const char* cstr) { return cstr ? concat(cstr, strlen(cstr)) : false; }
+    bool concat(char c) { return concat(&c, 1); }
+    bool concat(int value) { String s(value); return concat(s); }
+    bool concat(unsigned int value) { String s(value); return concat(s); }
+    bool concat(long value) { String s(value); return concat(s); }
+    bool concat(unsigned long value) { String s(value); return concat(s); }
+
+    template <typename T>
+    String& operator+=(const T& rhs) { concat(rhs); return *this; }
+
+    friend StringSumHelper& operator+(const StringSumHelper& lhs, const String& rhs);
+    friend StringSumHelper& operator+(const StringSumHelper& lhs, const char* cstr);
+    friend StringSumHelper& operator+(const StringSumHelper& lhs, char c);
+    friend StringSumHelper& operator+(const StringSumHelper& lhs, int value);
+
+    unsigned int length() const { return len; }
+    bool isEmpty() const { return len == 0; }
+    const char* c_str() const { return sso ? local : heap; }
+    char charAt(unsigned int index) const { return index < len ? c_str()[index] : 0; }
+    char operator[](unsigned int index) const { return charAt(index); }
+
+    bool equals(const char* cstr) const { return strcmp(c_str(), cstr ? cstr : "") == 0; }
+    bool operator==(const String& rhs) const { return len == rhs.len && equals(rhs.c_str()); }
+    bool operator==(const char* cstr) const { return equals(cstr); }
+    bool operator!=(const String& rhs) const { return !(*this == rhs); }
+    bool operator!=(const char* cstr) const { return !equals(cstr); }
+
+    int indexOf(char c, unsigned int from = 0) const {
+        if (from >= len) return -1;
+        const char* found = strchr(c_str() + from, c);
+        return found ? found - c_str() : -1;
+    }
+    int indexOf(const String& s, unsigned int from = 0) const {
+        if (from >= len) return -1;
+        const char* found = strstr(c_str() + from, s.c_str());
+        return found ? found - c_str() : -1;
+    }
+
+    void remove(unsigned int index, unsigned int count) {
+        if (index >= len) return;
+        if (count > len - index) count = len - index;
+        memmove(buffer() + index, buffer() + index + count, len - index - count + 1);
+        len -= count;
+    }
+
+    String substring(unsigned int from, unsigned int to) const {
+        if (from > to) { unsigned int t = from; from = to; to = t; }
+        if (from > len) return String();
+        if (to > len) to = len;
+        String out;
+        out.concat(c_str() + from, to - from);
+        return out;
+    }
+    String substring(unsigned int from) const { return substring(from, len); }
+
+    void toUpperCase() { for (char* p = buffer(); *p; p++) if (*p >= 'a' && *p <= 'z') *p -= 32; }
+    void toLowerCase() { for (char* p = buffer(); *p; p++) if (*p >= 'A' && *p <= 'Z') *p += 32; }
+    void trim() {
+        char* b = buffer();
+        unsigned int start = 0;
+        while (start < len && (b[start] == ' ' || b[start] == '\t' || b[start] == '\r' || b[start] == '\n')) start++;
+        unsigned int end = len;
+        while (end > start && (b[end - 1] == ' ' || b[end - 1] == '\t' || b[end - 1] == '\r' || b[end - 1] == '\n')) end--;
+        memmove(b, b + start, end - start);
+        len = end - start;
+        b[len] = '\0';
+    }
+
+private:
+    static const unsigned int SSO_SIZE = 11;  // Inline buffer of the 32-bit core
+
+    char* heap;
+    unsigned int capacity;
+    unsigned int len;
+    bool sso;
+    char local[SSO_SIZE];
+
+    void init() { heap = nullptr; capacity = SSO_SIZE - 1; len = 0; sso = true; local[0] = '\0'; }
+    char* buffer() { return sso ? local : heap; }
+
+    bool changeBuffer(unsigned int maxLength) {
+        if (maxLength < SSO_SIZE - 1) {
+            return true;
+        }
+        unsigned int newSize = (maxLength + 16) & ~0xfu;
+        char* newBuffer = (char*)hostalloc::reallocate(sso ? nullptr : heap, newSize);
+        if (!newBuffer) return false;
+        if (sso) memcpy(newBuffer, local, len + 1);
+        heap = newBuffer;
+        sso = false;
+        capacity = newSize - 1;
+        return true;
+    }
+
+    void copy(const char* cstr, unsigned int length) {
+        if (!reserve(length)) { len = 0; return; }
+        memmove(buffer(), cstr, length);
+        len = length;
+        buffer()[len] = '\0';
+    }
+
+    void move(String& rhs) {
+        if (!sso) hostalloc::release(heap);
+        heap = rhs.heap;
+        capacity = rhs.capacity;
+        len = rhs.len;
+        sso = rhs.sso;
+        memcpy(local, rhs.local, SSO_SIZE);
+        rhs.init();
+    }
+
+    void signedNumber(long value, unsigned char base) {
+        if (base != 10) {
+            unsignedNumber((unsigned long)value, base);
+            return;
+        }
+        char digits[24];
+        snprintf(digits, sizeof(digits), "%ld", value);
+        copy(digits, strlen(digits));
+    }
+    void unsignedNumber(unsigned long value, unsigned char base) {
+        char digits[24];
+        snprintf(digits, sizeof(digits), base == 16 ? "%lx" : "%lu", value);
+        copy(digits, strlen(digits));
+    }
+};
+
+class StringSumHelper : public String {
+public:
+    StringSumHelper(const String& s) : String(s) {}
+    StringSumHelper(const char* p) : String(p) {}
+    StringSumHelper(char c) : String(c) {}
+    StringSumHelper(int num) : String(num) {}
+};
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs, const String& rhs) {
+    StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+    a.concat(rhs);
+    return a;
+}
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs, const char* cstr) {
+    StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+    a.concat(cstr);
+    return a;
+}
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs, char c) {
+    StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+    a.concat(c);
+    return a;
+}
+
+inline StringSumHelper& operator+(const StringSumHelper& lhs, int value) {
+    StringSumHelper& a = const_cast<StringSumHelper&>(lhs);
+    a.concat(value);
+    return a;
+}
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef WIFI_H
+#define WIFI_H
+
+#include <Arduino.h>
+
+#define WIFI_SCAN_MAX 64
+
+// Scan record as kept by the ESP-IDF WiFi driver, fields used by the firmware
+struct wifi_ap_record_t {
+    uint8_t ssid[33];
+    int8_t rssi;
+};
+
+// Fake scan results for the host build
+class WiFiClass {
+public:
+    WiFiClass() : networks(0) {}
+
+    // Fill the results with count networks of realistic name length, every
+    // fifth name needs escaping
+    void setScanResults(int count) {
+        networks = count < WIFI_SCAN_MAX ? count : WIFI_SCAN_MAX;
+        for (int i = 0; i < networks; i++) {
+            const char* format = i % 5 == 4 ? "Guest \"%02d\"\t\\" : "HomeNetwork-%02d";
+            snprintf((char*)records[i].ssid, sizeof(records[i].ssid), format, i);
+            records[i].rssi = -40 - (i * 3) % 50;
+        }
+    }
+
+    int16_t scanNetworks() { return networks; }
+    String SSID(uint8_t i) { return i < networks ? String((const char*)records[i].ssid) : String(); }
+    int32_t RSSI(uint8_t i) { return i < networks ? records[i].rssi : 0; }
+    void* getScanInfoByIndex(int i) { return i >= 0 && i < networks ? &records[i] : nullptr; }
+
+private:
+    int networks;
+    wifi_ap_record_t records[WIFI_SCAN_MAX];
+};
+
+extern WiFiClass WiFi;
+
+#endif
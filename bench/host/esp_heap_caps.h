@@ -0,0 +1,15 @@
+#ifndef ESP_HEAP_CAPS_H
+#define ESP_HEAP_CAPS_H
+
+// No PSRAM on the host, framebuffers use malloc()
+
+#include <cstdlib>
+
+#define MALLOC_CAP_SPIRAM (1 << 10)
+#define MALLOC_CAP_8BIT (1 << 2)
+
+inline void* heap_caps_malloc(size_t size, uint32_t) {
+    return malloc(size);
+}
+
+#endif
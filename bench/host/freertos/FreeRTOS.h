@@ -0,0 +1,119 @@
+#ifndef FREERTOS_H
+#define FREERTOS_H
+
+// FreeRTOS subset used by log_buffer.cpp, device_state.cpp, lamp_sync.cpp
+// and segment_renderer.cpp, mapped to std::thread and std::mutex on the host
+
+#include <mutex>
+#include <condition_variable>
+#include <thread>
+#include <chrono>
+
+typedef void* TaskHandle_t;
+typedef int BaseType_t;
+
+#define pdPASS 1
+#define pdFAIL 0
+#define pdTRUE 1
+#define portMAX_DELAY 0xffffffff
+#define tskIDLE_PRIORITY 0
+#define pdMS_TO_TICKS(ms) (ms)
+#define portNUM_PROCESSORS 2
+
+typedef std::mutex portMUX_TYPE;
+#define portMUX_INITIALIZER_UNLOCKED {}
+#define portENTER_CRITICAL(mux) (mux)->lock()
+#define portEXIT_CRITICAL(mux) (mux)->unlock()
+
+// Counting semaphore, a mutex is one that starts given. Unlike std::mutex
+// it may be given by another thread than the one that took it.
+struct HostSemaphore {
+    std::mutex lock;
+    std::condition_variable changed;
+    unsigned count;
+
+    explicit HostSemaphore(unsigned count) : count(count) {}
+
+    void take() {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return count > 0; });
+        count--;
+    }
+
+    // Takes all, returns how many were given
+    unsigned takeAll() {
+        std::unique_lock<std::mutex> guard(lock);
+        changed.wait(guard, [this] { return count > 0; });
+        unsigned taken = count;
+        count = 0;
+        return taken;
+    }
+
+    void give(unsigned limit) {
+        std::lock_guard<std::mutex> guard(lock);
+        if (count < limit) count++;
+        changed.notify_one();
+    }
+};
+
+typedef HostSemaphore* SemaphoreHandle_t;
+
+inline SemaphoreHandle_t xSemaphoreCreateMutex() { return new HostSemaphore(1); }
+inline SemaphoreHandle_t xSemaphoreCreateBinary() { return new HostSemaphore(0); }
+inline BaseType_t xSemaphoreTake(SemaphoreHandle_t semaphore, unsigned long) {
+    semaphore->take();
+    return pdTRUE;
+}
+inline void xSemaphoreGive(SemaphoreHandle_t semaphore) { semaphore->give(1); }
+inline void vSemaphoreDelete(SemaphoreHandle_t semaphore) { delete semaphore; }
+inline void vTaskDelay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+
+// A task handle is the task itself, its notification value is a semaphore
+struct HostTask {
+    void (*code)(void*);
+    void* parameter;
+    int core;
+    HostSemaphore notification{0};
+};
+
+inline thread_local int hostCoreID = 0;
+inline thread_local HostTask* hostCurrentTask = nullptr;
+
+inline BaseType_t xPortGetCoreID() { return hostCoreID; }
+
+inline BaseType_t xTaskCreatePinnedToCore(void (*code)(void*), const char*, unsigned, void* parameter,
+                                          unsigned, TaskHandle_t* handle, BaseType_t core) {
+    // Never freed, tasks run until the process ends
+    HostTask* task = new HostTask{code, parameter, core};
+    if (handle) *handle = task;
+    std::thread([task] {
+        hostCoreID = task->core;
+        hostCurrentTask = task;
+        task->code(task->parameter);
+    }).detach();
+    return pdPASS;
+}
+
+inline BaseType_t xTaskCreate(void (*code)(void*), const char* name, unsigned stack, void* parameter,
+                              unsigned priority, TaskHandle_t* handle) {
+    return xTaskCreatePinnedToCore(code, name, stack, parameter, priority, handle, 0);
+}
+
+inline void xTaskNotifyGive(TaskHandle_t task) {
+    ((HostTask*)task)->notification.give(~0u);
+}
+
+// Waits forever, the timeout is ignored
+inline unsigned long ulTaskNotifyTake(BaseType_t clear, unsigned long) {
+    HostSemaphore& notification = hostCurrentTask->notification;
+    if (clear) return notification.takeAll();
+    notification.take();
+    return 1;
+}
+
+// Threads are not stopped. A task deletes itself right before it returns,
+// other tasks are only deleted while they wait for a notification that
+// never comes.
+inline void vTaskDelete(TaskHandle_t) {}
+
+#endif
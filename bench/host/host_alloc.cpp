@@ -0,0 +1,82 @@
+#include "host_alloc.h"
+#include <cstdlib>
+#include <new>
+
+namespace hostalloc {
+
+// Each block starts with its size, kept 16 byte aligned
+static const size_t PREFIX = 16;
+static Stats counters = { 0, 0, 0 };
+
+static void track(size_t added, size_t removed) {
+    counters.liveBytes += added;
+    counters.liveBytes -= removed;
+    if (counters.liveBytes > counters.peakBytes) {
+        counters.peakBytes = counters.liveBytes;
+    }
+}
+
+void* allocate(size_t size) {
+    char* block = (char*)malloc(size + PREFIX);
+    if (!block) return nullptr;
+    *(size_t*)block = size;
+    counters.allocations++;
+    track(size, 0);
+    return block + PREFIX;
+}
+
+void* reallocate(void* pointer, size_t size) {
+    if (!pointer) return allocate(size);
+
+    char* block = (char*)pointer - PREFIX;
+    size_t oldSize = *(size_t*)block;
+    block = (char*)realloc(block, size + PREFIX);
+    if (!block) return nullptr;
+    *(size_t*)block = size;
+    counters.allocations++;
+    track(size, oldSize);
+    return block + PREFIX;
+}
+
+void release(void* pointer) {
+    if (!pointer) return;
+    char* block = (char*)pointer - PREFIX;
+    track(0, *(size_t*)block);
+    free(block);
+}
+
+const Stats& stats() {
+    return counters;
+}
+
+void resetPeak() {
+    counters.peakBytes = counters.liveBytes;
+}
+
+}  // namespace hostalloc
+
+void* operator new(size_t size) {
+    void* pointer = hostalloc::allocate(size);
+    if (!pointer) throw std::bad_alloc();
+    return pointer;
+}
+
+void* operator new[](size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* pointer) noexcept {
+    hostalloc::release(pointer);
+}
+
+void operator delete[](void* pointer) noexcept {
+    hostalloc::release(pointer);
+}
+
+void operator delete(void* pointer, size_t) noexcept {
+    hostalloc::release(pointer);
+}
+
+void operator delete[](void* pointer, size_t) noexcept {
+    hostalloc::release(pointer);
+}
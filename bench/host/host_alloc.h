@@ -0,0 +1,25 @@
+#ifndef HOST_ALLOC_H
+#define HOST_ALLOC_H
+
+#include <cstddef>
+
+// Counting heap for the host build. String and operator new go through it,
+// so benchmarks see every allocation the code under test makes.
+namespace hostalloc {
+
+struct Stats {
+    unsigned long allocations;  // malloc, new and growing realloc calls
+    size_t liveBytes;
+    size_t peakBytes;
+};
+
+void* allocate(size_t size);
+void* reallocate(void* pointer, size_t size);
+void release(void* pointer);
+
+const Stats& stats();
+void resetPeak();  // Peak starts again at the current live bytes
+
+}  // namespace hostalloc
+
+#endif
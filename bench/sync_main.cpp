@@ -0,0 +1,131 @@
+// One lamp of the multicast clock sync on the host, see docs/LAMP_SYNC.md.
+// Started several times with different clocks by tools/sync_test.py.
+//
+//   sync_lamp --id 2 --offset-us 4000000 --drift-ppm 35 --duration 15
+//
+// Prints JSON lines: the shared clock every 200 ms, every scene frame
+// with the real (CLOCK_MONOTONIC) time it was rendered at, and the real
+// time of a scene end it requested.
+
+#include <Arduino.h>
+#include <chrono>
+#include <string>
+#include "lamp_sync.h"
+#include "log_buffer.h"
+#include <lwip/sockets.h>
+
+#define FRAME_MILLIS 20     // 50 fps like the lamp
+#define LOOP_MILLIS 10      // loop() period without a scene frame due sooner
+#define REPORT_MICROS 200000
+
+HardwareSerial Serial;
+
+// Simulated crystal: local = real * (1 + drift) + offset
+static double drift = 0.0;
+static int64_t offset = 0;
+
+static int64_t realMicros() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t localMicros() {
+    int64_t real = realMicros();
+    return real + (int64_t)(real * drift) + offset;
+}
+
+int main(int argc, char** argv) {
+    uint32_t id = 1;
+    double duration = 10.0;
+    double sceneAt = -1.0;
+    double sceneEndAt = -1.0;
+    uint32_t sceneDelay = SYNC_SCENE_DELAY;
+    const char* interface = "127.0.0.1";
+
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string option = argv[i];
+        const char* value = argv[i + 1];
+        if (option == "--id") id = strtoul(value, nullptr, 0);
+        else if (option == "--offset-us") offset = strtoll(value, nullptr, 0);
+        else if (option == "--drift-ppm") drift = atof(value) * 1e-6;
+        else if (option == "--duration") duration = atof(value);
+        else if (option == "--scene-at") sceneAt = atof(value);
+        else if (option == "--scene-delay") sceneDelay = strtoul(value, nullptr, 0);
+        else if (option == "--scene-end-at") sceneEndAt = atof(value);
+        else if (option == "--interface") interface = value;
+        else {
+            fprintf(stderr, "unknown option %s\n", option.c_str());
+            return 2;
+        }
+    }
+
+    setvbuf(stdout, nullptr, _IOLBF, 0);
+    beginLog();
+
+    LampSync sync;
+    if (!sync.begin(id, localMicros, inet_addr(interface))) {
+        fprintf(stderr, "lamp %u: sync failed to start\n", (unsigned)id);
+        return 1;
+    }
+
+    int64_t start = realMicros();
+    int64_t end = start + (int64_t)(duration * 1e6);
+    int64_t nextReport = start;
+    bool sceneRequested = false;
+    bool sceneEndRequested = false;
+    uint32_t lastFrame = UINT32_MAX;
+
+    while (true) {
+        int64_t real = realMicros();
+        if (real >= end) break;
+
+        if (!sceneRequested && sceneAt >= 0 && real - start >= sceneAt * 1e6) {
+            requestScene(sceneDelay);
+            sceneRequested = true;
+        }
+        if (!sceneEndRequested && sceneEndAt >= 0 && real - start >= sceneEndAt * 1e6) {
+            requestSceneEnd();
+            sceneEndRequested = true;
+            printf("{\"type\":\"scene_end\",\"id\":%u,\"real\":%lld}\n", (unsigned)id, (long long)real);
+        }
+
+        // Same frame pacing as renderFrame() on the lamp
+        uint32_t sceneMillis;
+        if (sync.getSceneMillis(localMicros(), sceneMillis)) {
+            uint32_t frame = sceneMillis / FRAME_MILLIS;
+            if (frame != lastFrame) {
+                lastFrame = frame;
+                printf("{\"type\":\"frame\",\"id\":%u,\"frame\":%u,\"real\":%lld}\n",
+                       (unsigned)id, (unsigned)frame, (long long)realMicros());
+            }
+        }
+
+        if (real >= nextReport) {
+            nextReport += REPORT_MICROS;
+            SyncState state;
+            int64_t before = realMicros();
+            int64_t shared = sync.toShared(localMicros());
+            int64_t after = realMicros();
+            sync.getState(state);
+            printf("{\"type\":\"clock\",\"id\":%u,\"real\":%lld,\"shared\":%lld,\"role\":\"%s\","
+                   "\"master\":%u,\"synced\":%s,\"error_us\":%d,\"jitter_us\":%u,\"delay_us\":%u,"
+                   "\"drift_ppb\":%d,\"samples\":%u,\"rejected\":%u}\n",
+                   (unsigned)id, (long long)((before + after) / 2), (long long)shared,
+                   getSyncRoleName(state.role), (unsigned)state.master,
+                   state.synced ? "true" : "false", (int)state.errorMicros,
+                   (unsigned)state.jitterMicros, (unsigned)state.delayMicros,
+                   (int)state.driftPpb, (unsigned)state.samples, (unsigned)state.rejected);
+        }
+
+        // Same period as loopDelayMillis() on the lamp
+        unsigned long waitMillis = LOOP_MILLIS;
+        uint32_t waitMicros;
+        if (sync.getSceneFrameWait(localMicros(), FRAME_MILLIS, waitMicros) && waitMicros < LOOP_MILLIS * 1000) {
+            waitMillis = (waitMicros + 999) / 1000;
+        }
+        delay(waitMillis);
+    }
+
+    // The destructor waits until the task closed its socket
+    return 0;
+}
@@ -0,0 +1,167 @@
+#include "benchmarks.h"
+#include "effect_vm.h"
+#include "native_effects.h"
+#include "segment_renderer.h"
+#include "color_tables.h"
+#include "color_float.h"
+#include <math.h>
+
+// Compact frames on RMT are read while they are sent, nothing may render
+// into the frame before the outputs are done
+static void waitForOutputs(LedOutput& leds) {
+    while (!leds.canShow()) {
+        yield();
+    }
+}
+
+void benchmarkLeds(LedOutput& leds, FrameBuffer& frame) {
+    const int frames = 200;
+    // 16 moving blocks keep the run count of the RLE format low
+    const uint16_t block = max(leds.getPixelCount() / 16, 1);
+
+    Serial.printf("\nLED benchmark: %d LEDs on %d output(s), %s framebuffer\n",
+                  leds.getPixelCount(), leds.getOutputCount(), frame.getFormatName());
+
+    waitForOutputs(leds);
+
+    unsigned long start = micros();
+    for (int n = 0; n < frames; n++) {
+        // Like the render loop, the next frame once the outputs are done
+        waitForOutputs(leds);
+        for (uint16_t i = 0; i < leds.getPixelCount(); i += block) {
+            frame.fill(i, block, RgbwColor((i / block + n) & 0x1f, 0, 0, 0));
+        }
+        leds.show(frame);
+    }
+    waitForOutputs(leds);
+    unsigned long elapsed = micros() - start;
+
+    Serial.printf("  Frame time: %lu us (wire limit %lu us)\n",
+                  elapsed / frames, leds.getFrameMicros());
+    Serial.printf("  Frame rate: %.1f FPS\n", frames * 1000000.0f / elapsed);
+
+    frame.clear();
+    leds.show(frame);
+}
+
+void benchmarkEffect(LedOutput& leds, FrameBuffer& frame) {
+    const int frames = 100;
+    AmbientWaveEffect native;
+    ScriptEffect* script = new ScriptEffect();
+    script->load(AMBIENT_WAVE_PROGRAM, AMBIENT_WAVE_PROGRAM_SIZE);
+
+    Serial.printf("\nEffect benchmark: ambient wave, %d LEDs\n", frame.getPixelCount());
+    waitForOutputs(leds);
+
+    unsigned long start = micros();
+    for (int n = 0; n < frames; n++) {
+        native.render(frame, 0, frame.getPixelCount(), n * 20);
+    }
+    unsigned long nativeMicros = (micros() - start) / frames;
+
+    start = micros();
+    for (int n = 0; n < frames; n++) {
+        script->render(frame, 0, frame.getPixelCount(), n * 20);
+    }
+    unsigned long scriptMicros = (micros() - start) / frames;
+
+    Serial.printf("  Native: %lu us/frame\n", nativeMicros);
+    Serial.printf("  Script: %lu us/frame, %u instructions, %u budget overruns\n",
+                  scriptMicros, script->getLastInstructions(), script->getBudgetOverruns());
+    if (nativeMicros > 0) {
+        Serial.printf("  Script is %.1fx slower\n", (float)scriptMicros / nativeMicros);
+    }
+
+    delete script;
+}
+
+void benchmarkSegments(LedOutput& leds, FrameBuffer& frame) {
+    const int frames = 50;
+    const uint8_t segmentCounts[] = { 1, 2, 4, 8 };
+
+    Serial.printf("\nSegment benchmark: ambient wave script, %d LEDs\n", frame.getPixelCount());
+
+    ScriptEffect* scripts = new ScriptEffect[SEGMENT_MAX];
+    for (uint8_t i = 0; i < SEGMENT_MAX; i++) {
+        scripts[i].load(AMBIENT_WAVE_PROGRAM, AMBIENT_WAVE_PROGRAM_SIZE);
+    }
+
+    // One renderer and worker for all runs, only the map changes
+    SegmentRenderer bench(frame.getPixelCount());
+    bench.begin();
+    waitForOutputs(leds);
+
+    for (uint8_t segments : segmentCounts) {
+        for (int parallel = 0; parallel <= 1; parallel++) {
+            bench.clearSegments();
+            bench.setParallel(parallel);
+
+            uint16_t length = frame.getPixelCount() / segments;
+            for (uint8_t i = 0; i < segments; i++) {
+                bench.addSegment(i * length, length, &scripts[i]);
+            }
+
+            unsigned long core0 = 0, core1 = 0, compose = 0, total = 0;
+            for (int n = 0; n < frames; n++) {
+                bench.render(frame, n * 20);
+                const RenderStats& stats = bench.getStats();
+                core0 += stats.coreMicros[0];
+                core1 += stats.coreMicros[1];
+                compose += stats.composeMicros;
+                total += stats.frameMicros;
+            }
+
+            Serial.printf("  %d segment(s), %s: core 0 %lu us, core 1 %lu us, compose %lu us, frame %lu us\n",
+                          segments, parallel ? "2 cores" : "1 core ",
+                          core0 / frames, core1 / frames, compose / frames, total / frames);
+        }
+    }
+
+    delete[] scripts;
+}
+
+void benchmarkColor(LedOutput& leds, FrameBuffer& frame) {
+    const int frames = 50;
+    uint16_t count = frame.getPixelCount();
+
+    Serial.printf("\nColor benchmark: %d LEDs\n", count);
+    waitForOutputs(leds);
+
+    // Script colors (rgb instruction): gamma and white split for every
+    // pixel, a gradient so each one needs its own conversion
+    unsigned long start = micros();
+    for (int n = 0; n < frames; n++) {
+        for (uint16_t i = 0; i < count; i++) {
+            float r = (float)i / count;
+            frame.setPixelColor(i, LedColorFloat::linearToRgbw(r, 0.6f * r + 0.002f * n, 0.3f));
+        }
+    }
+    unsigned long rgbFloatMicros = (micros() - start) / frames;
+
+    start = micros();
+    for (int n = 0; n < frames; n++) {
+        for (uint16_t i = 0; i < count; i++) {
+            uint16_t r = (uint32_t)65535 * i / count;
+            frame.setPixelColor(i, LedColor::linearToRgbw(r, r * 3 / 5 + 131 * n, 19661));
+        }
+    }
+    unsigned long rgbTableMicros = (micros() - start) / frames;
+
+    // ColorTemperatureEffect: one conversion per frame, then a fill
+    start = micros();
+    for (int n = 0; n < frames; n++) {
+        frame.fill(0, count, LedColorFloat::kelvinToRgbw(2700.0f + n, 0.5f));
+    }
+    unsigned long kelvinFloatMicros = (micros() - start) / frames;
+
+    ColorTemperatureEffect temperature;
+    start = micros();
+    for (int n = 0; n < frames; n++) {
+        temperature.setKelvin(2700 + n);
+        temperature.render(frame, 0, count, n * 20);
+    }
+    unsigned long kelvinTableMicros = (micros() - start) / frames;
+
+    Serial.printf("  rgb:         float %lu us/frame, table %lu us/frame\n", rgbFloatMicros, rgbTableMicros);
+    Serial.printf("  temperature: float %lu us/frame, table %lu us/frame\n", kelvinFloatMicros, kelvinTableMicros);
+}
@@ -0,0 +1,19 @@
+#ifndef BENCHMARKS_H
+#define BENCHMARKS_H
+
+#include <Arduino.h>
+#include "led_output.h"
+#include "frame_buffer.h"
+
+// Serial console benchmarks, results are printed to Serial.
+// They block the loop while running, use them on a bench, not in production.
+// They live apart from main.cpp, so only this unit includes the float
+// color conversions of color_float.h that "bench color" compares against.
+void benchmarkLeds(LedOutput& leds, FrameBuffer& frame);
+// The others render into the frame the outputs send, they wait until the
+// last frame is out first
+void benchmarkEffect(LedOutput& leds, FrameBuffer& frame);
+void benchmarkSegments(LedOutput& leds, FrameBuffer& frame);
+void benchmarkColor(LedOutput& leds, FrameBuffer& frame);
+
+#endif
@@ -0,0 +1,159 @@
+#include "captive_dns.h"
+#include "log_buffer.h"
+#include <lwip/sockets.h>
+
+#define DNS_HEADER_SIZE 12
+#define DNS_ANSWER_SIZE 16
+#define DNS_TYPE_A 1
+#define DNS_TYPE_ANY 255
+#define DNS_CLASS_IN 1
+
+CaptiveDns::CaptiveDns()
+    : sock(-1), windowStart(0), windowCount(0), windowLimited(0), answered(0), limited(0) {
+    memset(ip, 0, sizeof(ip));
+}
+
+CaptiveDns::~CaptiveDns() {
+    stop();
+}
+
+bool CaptiveDns::begin(const IPAddress& address) {
+    stop();
+
+    for (uint8_t i = 0; i < 4; i++) {
+        ip[i] = address[i];
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return false;
+    }
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(DNS_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0) {
+        stop();
+        return false;
+    }
+    return true;
+}
+
+void CaptiveDns::stop() {
+    if (sock >= 0) {
+        close(sock);
+        sock = -1;
+    }
+}
+
+void CaptiveDns::loop() {
+    if (sock < 0) {
+        return;
+    }
+
+    unsigned long now = millis();
+    if (now - windowStart >= 1000) {
+        if (windowLimited > 0) {
+            logEvent(LOG_DNS_LIMITED, windowLimited);
+        }
+        windowStart = now;
+        windowCount = 0;
+        windowLimited = 0;
+    }
+
+    // A bounded number of packets per call, a query flood only delays
+    // the next frame a little and leaves the rest to the socket buffer
+    for (uint8_t i = 0; i < DNS_MAX_PER_POLL; i++) {
+        struct sockaddr_in client;
+        socklen_t clientLength = sizeof(client);
+        int length = recvfrom(sock, buffer, sizeof(buffer), MSG_DONTWAIT,
+                              (struct sockaddr*)&client, &clientLength);
+        if (length <= 0) {
+            return;
+        }
+
+        if (windowCount >= DNS_RATE_LIMIT) {
+            windowLimited++;
+            limited++;
+            continue;
+        }
+
+        size_t responseLength = buildResponse(length);
+        if (responseLength == 0) {
+            continue;
+        }
+
+        windowCount++;
+        if (sendto(sock, buffer, responseLength, 0, (struct sockaddr*)&client, clientLength) > 0) {
+            answered++;
+        }
+    }
+}
+
+// Turns the query in buffer into its response, returns the response length
+// or 0 when the packet is not answered
+size_t CaptiveDns::buildResponse(size_t length) {
+    if (length < DNS_HEADER_SIZE) {
+        return 0;
+    }
+
+    // Standard queries (QR = 0, opcode 0) with exactly one question
+    uint8_t* header = buffer;
+    if ((header[2] & 0xF8) != 0 || header[4] != 0 || header[5] != 1) {
+        return 0;
+    }
+
+    // Skip the question name, uncompressed labels ending with the root label
+    size_t pos = DNS_HEADER_SIZE;
+    while (pos < length && buffer[pos] != 0) {
+        if (buffer[pos] & 0xC0) {
+            return 0;
+        }
+        pos += buffer[pos] + 1;
+    }
+    if (pos >= length || pos + 5 > length) {
+        return 0;
+    }
+
+    uint16_t type = (buffer[pos + 1] << 8) | buffer[pos + 2];
+    uint16_t dnsClass = (buffer[pos + 3] << 8) | buffer[pos + 4];
+    pos += 5;
+
+    // AAAA and others get an empty NOERROR answer, so clients fall back
+    // to the A record instead of waiting for a timeout
+    bool answer = (type == DNS_TYPE_A || type == DNS_TYPE_ANY) && dnsClass == DNS_CLASS_IN;
+
+    header[2] = 0x84 | (header[2] & 0x01);  // Response, authoritative, keep RD
+    header[3] = 0x00;                       // No recursion, NOERROR
+    header[6] = 0;
+    header[7] = answer ? 1 : 0;             // Answers
+    memset(header + 8, 0, 4);               // No authority and additional records
+
+    // Anything after the question, e.g. an EDNS record, is cut off
+    if (!answer) {
+        return pos;
+    }
+    if (pos + DNS_ANSWER_SIZE > sizeof(buffer)) {
+        return 0;
+    }
+
+    uint8_t* record = buffer + pos;
+    record[0] = 0xC0;                       // Name: pointer to the question
+    record[1] = DNS_HEADER_SIZE;
+    record[2] = 0;
+    record[3] = DNS_TYPE_A;
+    record[4] = 0;
+    record[5] = DNS_CLASS_IN;
+    record[6] = (DNS_TTL >> 24) & 0xFF;
+    record[7] = (DNS_TTL >> 16) & 0xFF;
+    record[8] = (DNS_TTL >> 8) & 0xFF;
+    record[9] = DNS_TTL & 0xFF;
+    record[10] = 0;
+    record[11] = 4;                         // Address length
+    memcpy(record + 12, ip, 4);
+
+    return pos + DNS_ANSWER_SIZE;
+}
@@ -0,0 +1,53 @@
+#ifndef CAPTIVE_DNS_H
+#define CAPTIVE_DNS_H
+
+#include <Arduino.h>
+#include <IPAddress.h>
+
+// Answer DNS in the captive portal, build with 0 to compare without
+#ifndef CAPTIVE_DNS
+#define CAPTIVE_DNS 1
+#endif
+
+// Answered queries per second, further queries are dropped
+#ifndef DNS_RATE_LIMIT
+#define DNS_RATE_LIMIT 50
+#endif
+
+#define DNS_MAX_PER_POLL 4   // Packets handled per loop() call
+#define DNS_TTL 60           // Seconds, short so clients forget the portal IP soon
+#define DNS_PORT 53
+#define DNS_BUFFER_SIZE 512  // Largest plain DNS message over UDP
+
+// Minimal DNS server for the captive portal. Every A query is answered with
+// the portal IP, so clients resolving any host end up on the portal.
+//
+// Polled from loop() on a non-blocking socket. The response is built in
+// place in the receive buffer, nothing is allocated per query.
+class CaptiveDns {
+public:
+    CaptiveDns();
+    ~CaptiveDns();
+
+    bool begin(const IPAddress& ip);
+    void stop();
+    void loop();
+
+    uint32_t getAnswered() const { return answered; }
+    uint32_t getLimited() const { return limited; }
+
+private:
+    int sock;
+    uint8_t ip[4];
+    uint8_t buffer[DNS_BUFFER_SIZE];
+
+    unsigned long windowStart;
+    uint16_t windowCount;
+    uint16_t windowLimited;
+    uint32_t answered;
+    uint32_t limited;
+
+    size_t buildResponse(size_t length);
+};
+
+#endif
@@ -0,0 +1,63 @@
+#ifndef COLOR_FLOAT_H
+#define COLOR_FLOAT_H
+
+#include <Arduino.h>
+#include <math.h>
+#include "color_tables.h"
+
+// Float versions of the ColorTables conversions, what every pixel would
+// cost without the tables. Only the color benchmarks use them.
+template <typename T_VARIANT>
+class ColorFloat {
+public:
+    // Same as ColorTables::linearToRgbw(), channels 0..1
+    static RgbwColor linearToRgbw(float r, float g, float b) {
+        return split(gamma(r), gamma(g), gamma(b), 1.0f);
+    }
+
+    // Same as ColorTables::kelvinToRgbw(), level 0..1
+    static RgbwColor kelvinToRgbw(float kelvin, float level) {
+        float t = kelvin / 100.0f;
+        float r = 255.0f, g, b = 255.0f;
+
+        if (t <= 66.0f) {
+            g = 99.4708025861f * logf(t) - 161.1195681661f;
+        } else {
+            r = 329.698727446f * powf(t - 60.0f, -0.1332047592f);
+            g = 288.1221695283f * powf(t - 60.0f, -0.0755148492f);
+        }
+        if (t < 66.0f) {
+            b = t <= 19.0f ? 0.0f : 138.5177312231f * logf(t - 10.0f) - 305.0447927307f;
+        }
+
+        return split(clamp(r, 255.0f), clamp(g, 255.0f), clamp(b, 255.0f),
+                     powf(level, (float)T_VARIANT::GAMMA));
+    }
+
+private:
+    // White LED of the variant, computed at compile time like the tables
+    static constexpr colormath::Rgb WHITE = colormath::kelvinToRgb(T_VARIANT::WHITE_KELVIN);
+
+    static float clamp(float v, float top) {
+        return fminf(fmaxf(v, 0.0f), top);
+    }
+
+    static float gamma(float level) {
+        return powf(clamp(level, 1.0f), (float)T_VARIANT::GAMMA) * 255.0f;
+    }
+
+    // Moves as much of r, g, b (0..255) as possible onto the white LED
+    static RgbwColor split(float r, float g, float b, float scale) {
+        const float wr = WHITE.r, wg = WHITE.g, wb = WHITE.b;
+        float w = fminf(fminf(r * 255.0f / wr, g * 255.0f / wg), fminf(b * 255.0f / wb, 255.0f));
+
+        return RgbwColor((r - w * wr / 255.0f) * scale + 0.5f,
+                         (g - w * wg / 255.0f) * scale + 0.5f,
+                         (b - w * wb / 255.0f) * scale + 0.5f,
+                         w * scale + 0.5f);
+    }
+};
+
+typedef ColorFloat<LED_VARIANT> LedColorFloat;
+
+#endif
@@ -0,0 +1,225 @@
+#ifndef COLOR_TABLES_H
+#define COLOR_TABLES_H
+
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+
+// Color conversion lookup tables, generated at compile time for the LED
+// variant of the strip. Effects use them instead of per-pixel float math.
+
+// SK6812 RGBW variants, the white LED color decides the RGB -> RGBW split
+struct Sk6812WarmWhite {
+    static constexpr uint16_t WHITE_KELVIN = 3000;
+    static constexpr double GAMMA = 2.8;
+};
+
+struct Sk6812NeutralWhite {
+    static constexpr uint16_t WHITE_KELVIN = 4500;
+    static constexpr double GAMMA = 2.8;
+};
+
+struct Sk6812CoolWhite {
+    static constexpr uint16_t WHITE_KELVIN = 6500;
+    static constexpr double GAMMA = 2.8;
+};
+
+// LED variant of the strip, one of the structs above
+#ifndef LED_VARIANT
+#define LED_VARIANT Sk6812WarmWhite
+#endif
+
+#define KELVIN_MIN 1000
+#define KELVIN_MAX 10000
+#define KELVIN_STEP 100
+
+// constexpr replacements for exp/log/pow, std:: versions are not constexpr
+namespace colormath {
+
+constexpr double LN2 = 0.6931471805599453;
+
+constexpr double exp(double x) {
+    int n = (int)(x / LN2);
+    if (x < 0) n--;
+    double r = x - n * LN2;  // 0..ln2
+
+    double term = 1.0;
+    double sum = 1.0;
+    for (int i = 1; i < 20; i++) {
+        term *= r / i;
+        sum += term;
+    }
+    for (; n > 0; n--) sum *= 2.0;
+    for (; n < 0; n++) sum /= 2.0;
+    return sum;
+}
+
+constexpr double log(double x) {
+    int k = 0;
+    while (x >= 2.0) { x /= 2.0; k++; }
+    while (x < 1.0) { x *= 2.0; k--; }
+
+    // ln(x) = 2 * atanh((x - 1) / (x + 1)), x in 1..2
+    double z = (x - 1.0) / (x + 1.0);
+    double term = z;
+    double sum = 0.0;
+    for (int i = 1; i < 40; i += 2) {
+        sum += term / i;
+        term *= z * z;
+    }
+    return 2.0 * sum + k * LN2;
+}
+
+constexpr double pow(double base, double exponent) {
+    return base <= 0.0 ? 0.0 : exp(exponent * log(base));
+}
+
+constexpr uint8_t clampByte(double v) {
+    return v <= 0.0 ? 0 : (v >= 255.0 ? 255 : (uint8_t)(v + 0.5));
+}
+
+struct Rgb {
+    double r, g, b;
+};
+
+// Black body color of a temperature, Tanner Helland's fit, 0..255
+constexpr Rgb kelvinToRgb(double kelvin) {
+    double t = kelvin / 100.0;
+    Rgb c = { 255.0, 0.0, 255.0 };
+
+    if (t <= 66.0) {
+        c.g = 99.4708025861 * log(t) - 161.1195681661;
+    } else {
+        c.r = 329.698727446 * pow(t - 60.0, -0.1332047592);
+        c.g = 288.1221695283 * pow(t - 60.0, -0.0755148492);
+    }
+
+    if (t < 66.0) {
+        c.b = t <= 19.0 ? 0.0 : 138.5177312231 * log(t - 10.0) - 305.0447927307;
+    }
+
+    c.r = c.r < 0.0 ? 0.0 : (c.r > 255.0 ? 255.0 : c.r);
+    c.g = c.g < 0.0 ? 0.0 : (c.g > 255.0 ? 255.0 : c.g);
+    c.b = c.b < 0.0 ? 0.0 : (c.b > 255.0 ? 255.0 : c.b);
+    return c;
+}
+
+// Gamma curve, GAMMA_SIZE entries over the full input range
+template <typename T_VARIANT, size_t GAMMA_SIZE>
+struct GammaTable {
+    uint8_t values[GAMMA_SIZE];
+
+    constexpr GammaTable() : values() {
+        for (size_t i = 0; i < GAMMA_SIZE; i++) {
+            values[i] = clampByte(
+                255.0 * pow((double)i / (GAMMA_SIZE - 1), T_VARIANT::GAMMA));
+        }
+    }
+};
+
+// White LED split tables
+// toWhite: channel value -> white level that channel allows
+// fromWhite: white level -> channel value the white LED provides
+template <typename T_VARIANT>
+struct WhiteTable {
+    uint8_t toWhite[3][256];
+    uint8_t fromWhite[3][256];
+
+    constexpr WhiteTable() : toWhite(), fromWhite() {
+        Rgb wp = kelvinToRgb(T_VARIANT::WHITE_KELVIN);
+        double white[3] = { wp.r, wp.g, wp.b };
+
+        for (uint8_t c = 0; c < 3; c++) {
+            for (int v = 0; v < 256; v++) {
+                toWhite[c][v] = white[c] < 1.0 ? 255 : clampByte(v * 255.0 / white[c] - 0.5);
+                fromWhite[c][v] = clampByte(v * white[c] / 255.0);
+            }
+        }
+    }
+};
+
+template <typename T_VARIANT, size_t KELVIN_SIZE>
+struct KelvinTable {
+    uint8_t values[KELVIN_SIZE][4];
+
+    constexpr KelvinTable() : values() {
+        Rgb wp = kelvinToRgb(T_VARIANT::WHITE_KELVIN);
+
+        for (size_t i = 0; i < KELVIN_SIZE; i++) {
+            Rgb c = kelvinToRgb(KELVIN_MIN + i * KELVIN_STEP);
+
+            // Take as much as possible from the white LED
+            double w = 255.0;
+            if (wp.r >= 1.0 && c.r * 255.0 / wp.r < w) w = c.r * 255.0 / wp.r;
+            if (wp.g >= 1.0 && c.g * 255.0 / wp.g < w) w = c.g * 255.0 / wp.g;
+            if (wp.b >= 1.0 && c.b * 255.0 / wp.b < w) w = c.b * 255.0 / wp.b;
+
+            values[i][0] = clampByte(c.r - w * wp.r / 255.0);
+            values[i][1] = clampByte(c.g - w * wp.g / 255.0);
+            values[i][2] = clampByte(c.b - w * wp.b / 255.0);
+            values[i][3] = clampByte(w);
+        }
+    }
+};
+
+}  // namespace colormath
+
+template <typename T_VARIANT, uint8_t T_GAMMA_BITS = 12>
+class ColorTables {
+public:
+    static constexpr size_t GAMMA_SIZE = (size_t)1 << T_GAMMA_BITS;
+    static constexpr size_t KELVIN_SIZE = (KELVIN_MAX - KELVIN_MIN) / KELVIN_STEP + 1;
+
+    // Linear 16-bit light level to gamma corrected 8-bit LED value
+    static uint8_t gamma16(uint16_t level) {
+        return gamma.values[level >> (16 - T_GAMMA_BITS)];
+    }
+
+    // Split an RGB color into RGBW using the white LED of the variant
+    static RgbwColor rgbToRgbw(uint8_t r, uint8_t g, uint8_t b) {
+        uint8_t w = white.toWhite[0][r];
+        if (white.toWhite[1][g] < w) w = white.toWhite[1][g];
+        if (white.toWhite[2][b] < w) w = white.toWhite[2][b];
+
+        return RgbwColor(r - white.fromWhite[0][w],
+                         g - white.fromWhite[1][w],
+                         b - white.fromWhite[2][w],
+                         w);
+    }
+
+    // Linear 16-bit light levels to a gamma corrected RGBW color, the
+    // rgb instruction of effect scripts
+    static RgbwColor linearToRgbw(uint16_t r, uint16_t g, uint16_t b) {
+        return rgbToRgbw(gamma16(r), gamma16(g), gamma16(b));
+    }
+
+    // Color temperature at a linear 16-bit light level, gamma corrected
+    static RgbwColor kelvinToRgbw(uint16_t kelvin, uint16_t level) {
+        if (kelvin < KELVIN_MIN) kelvin = KELVIN_MIN;
+        if (kelvin > KELVIN_MAX) kelvin = KELVIN_MAX;
+
+        // Interpolate between the two nearest table entries
+        uint16_t offset = kelvin - KELVIN_MIN;
+        uint16_t index = offset / KELVIN_STEP;
+        uint16_t fraction = offset % KELVIN_STEP;
+        const uint8_t* a = kelvinTable.values[index];
+        const uint8_t* b = kelvinTable.values[index + 1u < KELVIN_SIZE ? index + 1 : index];
+
+        uint16_t scale = gamma16(level) + 1;
+        uint8_t c[4];
+        for (uint8_t i = 0; i < 4; i++) {
+            uint16_t v = a[i] + ((b[i] - a[i]) * fraction) / KELVIN_STEP;
+            c[i] = (v * scale) >> 8;
+        }
+        return RgbwColor(c[0], c[1], c[2], c[3]);
+    }
+
+private:
+    static constexpr colormath::GammaTable<T_VARIANT, GAMMA_SIZE> gamma = {};
+    static constexpr colormath::WhiteTable<T_VARIANT> white = {};
+    static constexpr colormath::KelvinTable<T_VARIANT, KELVIN_SIZE> kelvinTable = {};
+};
+
+// Tables of the configured strip
+typedef ColorTables<LED_VARIANT> LedColor;
+
+#endif
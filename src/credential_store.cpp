@@ -0,0 +1,29 @@
+#include "credential_store.h"
+#include <Preferences.h>
+#include "log_buffer.h"
+
+bool loadWifiCredentials(String& ssid, String& password) {
+    Preferences prefs;
+    prefs.begin("wifi", true);  // Read-only
+    ssid = prefs.getString("ssid", "");
+    password = prefs.getString("password", "");
+    prefs.end();
+
+    return (ssid.length() > 0);
+}
+
+void saveWifiCredentials(const String& ssid, const String& password) {
+    Preferences prefs;
+    prefs.begin("wifi", false);  // Read-write
+    prefs.putString("ssid", ssid);
+    prefs.putString("password", password);
+    prefs.end();
+    logEvent(LOG_CREDENTIALS_SAVED);
+}
+
+void clearWifiCredentials() {
+    Preferences prefs;
+    prefs.begin("wifi", false);
+    prefs.clear();
+    prefs.end();
+}
@@ -0,0 +1,11 @@
+#ifndef CREDENTIAL_STORE_H
+#define CREDENTIAL_STORE_H
+
+#include <Arduino.h>
+
+// WiFi credentials, kept in NVS across restarts
+bool loadWifiCredentials(String& ssid, String& password);
+void saveWifiCredentials(const String& ssid, const String& password);
+void clearWifiCredentials();
+
+#endif
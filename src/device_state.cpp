@@ -0,0 +1,105 @@
+#include "device_state.h"
+#include <freertos/FreeRTOS.h>
+
+static portMUX_TYPE lightLock = portMUX_INITIALIZER_UNLOCKED;
+static LightState light = { "none", false, 0, 0, 0, 0, 0, 0 };
+
+void publishLightState(const LightState& state) {
+    portENTER_CRITICAL(&lightLock);
+    light = state;
+    portEXIT_CRITICAL(&lightLock);
+}
+
+LightState getLightState() {
+    portENTER_CRITICAL(&lightLock);
+    LightState state = light;
+    portEXIT_CRITICAL(&lightLock);
+    return state;
+}
+
+static portMUX_TYPE syncStateLock = portMUX_INITIALIZER_UNLOCKED;
+static SyncState sync = {};
+
+void publishSyncState(const SyncState& state) {
+    portENTER_CRITICAL(&syncStateLock);
+    sync = state;
+    portEXIT_CRITICAL(&syncStateLock);
+}
+
+SyncState getSyncState() {
+    portENTER_CRITICAL(&syncStateLock);
+    SyncState state = sync;
+    portEXIT_CRITICAL(&syncStateLock);
+    return state;
+}
+
+static void writeIP(JsonWriter& json, const uint8_t* ip) {
+    char text[16];
+    snprintf(text, sizeof(text), "%u.%u.%u.%u", ip[0], ip[1], ip[2], ip[3]);
+    json.value(text);
+}
+
+void writeStateJSON(JsonWriter& json, const DeviceState& state) {
+    json.beginObject();
+
+    json.key("light");
+    json.beginObject();
+    json.member("effect", state.light.effect);
+    json.member("script_loaded", state.light.scriptLoaded);
+    json.member("segments", state.light.segments);
+    json.member("pixels", state.light.pixels);
+    json.member("fps", state.light.fps);
+    json.member("frames", state.light.frames);
+    json.member("render_us", state.light.renderMicros);
+    json.member("show_us", state.light.showMicros);
+    json.endObject();
+
+    json.key("wifi");
+    json.beginObject();
+    json.member("connected", state.wifi.connected);
+    json.member("portal", state.wifi.portal);
+    json.key("ssid");
+    json.value(state.wifi.ssid, strnlen(state.wifi.ssid, sizeof(state.wifi.ssid)));
+    json.key("ip");
+    writeIP(json, state.wifi.ip);
+    json.member("rssi", state.wifi.rssi);
+    json.endObject();
+
+    json.key("system");
+    json.beginObject();
+    json.member("uptime_s", state.system.uptimeSeconds);
+    json.member("free_heap", state.system.freeHeap);
+    json.member("min_free_heap", state.system.minFreeHeap);
+    json.member("largest_free_block", state.system.largestFreeBlock);
+    json.member("free_psram", state.system.freePsram);
+    json.member("log_dropped", state.system.logDropped);
+    json.member("web_admitted", state.system.webAdmitted);
+    json.member("web_rejected", state.system.webRejected);
+    json.endObject();
+
+    json.key("sync");
+    json.beginObject();
+    json.member("role", getSyncRoleName(state.sync.role));
+    json.member("id", state.sync.id);
+    json.member("master", state.sync.master);
+    json.member("synced", state.sync.synced);
+    json.member("error_us", state.sync.errorMicros);
+    json.member("jitter_us", state.sync.jitterMicros);
+    json.member("delay_us", state.sync.delayMicros);
+    json.member("drift_ppb", state.sync.driftPpb);
+    json.member("samples", state.sync.samples);
+    json.member("rejected", state.sync.rejected);
+    json.key("peers");
+    json.beginArray();
+    for (uint8_t i = 0; i < state.sync.peerCount; i++) {
+        json.beginObject();
+        json.member("id", state.sync.peers[i].id);
+        json.member("error_us", state.sync.peers[i].errorMicros);
+        json.member("delay_us", state.sync.peers[i].delayMicros);
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+
+    json.endObject();
+}
@@ -0,0 +1,60 @@
+#ifndef DEVICE_STATE_H
+#define DEVICE_STATE_H
+
+#include <Arduino.h>
+#include "json_writer.h"
+#include "lamp_sync.h"
+
+// Buffer of the /api/state response
+#define STATE_JSON_SIZE 1536  // Worst case with all sync peers and an escaped SSID is about 1.35 KB
+
+struct LightState {
+    const char* effect;      // Effect of the base segment, static name
+    bool scriptLoaded;
+    uint8_t segments;
+    uint16_t pixels;
+    uint16_t fps;            // Target frame rate
+    uint32_t frames;
+    uint32_t renderMicros;   // Last frame: effects and blending
+    uint32_t showMicros;     // Last frame: LedOutput::show(), the transfer runs on after it
+};
+
+struct WifiState {
+    bool connected;
+    bool portal;             // Captive portal AP is running
+    char ssid[33];
+    uint8_t ip[4];
+    int8_t rssi;
+};
+
+struct SystemState {
+    uint32_t uptimeSeconds;
+    uint32_t freeHeap;
+    uint32_t minFreeHeap;
+    uint32_t largestFreeBlock;
+    uint32_t freePsram;
+    uint32_t logDropped;
+    uint32_t webAdmitted;
+    uint32_t webRejected;
+};
+
+struct DeviceState {
+    LightState light;
+    WifiState wifi;
+    SystemState system;
+    SyncState sync;
+};
+
+// Light state is published by the render loop once per frame and copied
+// by the web server, both under a short critical section
+void publishLightState(const LightState& state);
+LightState getLightState();
+
+// Sync state is published by the loop, same as the light state
+void publishSyncState(const SyncState& state);
+SyncState getSyncState();
+
+// Device state as JSON object, see docs/STATE_API.md
+void writeStateJSON(JsonWriter& json, const DeviceState& state);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef EFFECT_H
+#define EFFECT_H
+
+#include <Arduino.h>
+#include "frame_buffer.h"
+
+// A light effect renders a range of the framebuffer for a point in time.
+// Effects must not block, they are called once per frame from the render loop.
+class Effect {
+public:
+    virtual ~Effect() {}
+    virtual const char* getName() const = 0;
+    // Render pixels [start, start + count) of the frame
+    virtual void render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) = 0;
+};
+
+#endif
@@ -0,0 +1,49 @@
+#include "effect_store.h"
+#include <Preferences.h>
+#include "log_buffer.h"
+
+static volatile bool programChanged = false;
+
+bool saveEffectProgram(const uint8_t* data, size_t length) {
+    Preferences prefs;
+    prefs.begin("effect", false);  // Read-write
+    size_t written = prefs.putBytes("program", data, length);
+    prefs.end();
+
+    if (written != length) {
+        logEvent(LOG_EFFECT_SAVE_FAILED);
+        return false;
+    }
+
+    logEvent(LOG_EFFECT_SAVED, length);
+    programChanged = true;
+    return true;
+}
+
+size_t loadEffectProgram(uint8_t* data, size_t maxLength) {
+    Preferences prefs;
+    prefs.begin("effect", true);  // Read-only
+    size_t length = prefs.getBytesLength("program");
+    if (length > maxLength) {
+        length = 0;
+    } else if (length > 0) {
+        length = prefs.getBytes("program", data, maxLength);
+    }
+    prefs.end();
+    return length;
+}
+
+void clearEffectProgram() {
+    Preferences prefs;
+    prefs.begin("effect", false);
+    prefs.remove("program");
+    prefs.end();
+    logEvent(LOG_EFFECT_REMOVED);
+    programChanged = true;
+}
+
+bool takeEffectProgramChanged() {
+    if (!programChanged) return false;
+    programChanged = false;
+    return true;
+}
@@ -0,0 +1,15 @@
+#ifndef EFFECT_STORE_H
+#define EFFECT_STORE_H
+
+#include <Arduino.h>
+
+// Uploaded effect program, kept in NVS across restarts
+bool saveEffectProgram(const uint8_t* data, size_t length);
+size_t loadEffectProgram(uint8_t* data, size_t maxLength);
+void clearEffectProgram();
+
+// Set by the web server after an upload, taken by the render loop so the
+// program is only swapped between frames
+bool takeEffectProgramChanged();
+
+#endif
@@ -0,0 +1,388 @@
+#include "effect_vm.h"
+#include "color_tables.h"
+
+#define FX_ONE 65536
+
+static inline int32_t fxMul(int32_t a, int32_t b) {
+    return (int32_t)(((int64_t)a * b) >> 16);
+}
+
+// Scripts are uploaded and untrusted: arithmetic wraps around like the
+// hardware does instead of running into signed overflow
+static inline int32_t fxAdd(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static inline int32_t fxSub(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+static inline int32_t fxNeg(int32_t a) {
+    return (int32_t)(0u - (uint32_t)a);
+}
+
+static inline int32_t fxDiv(int32_t a, int32_t b) {
+    if (b == 0) return 0;
+    // -1 is -1/65536, the quotient is a * -65536
+    if (b == -1) return fxNeg((int32_t)((uint32_t)a << 16));
+    return (int32_t)(uint32_t)(((int64_t)a * FX_ONE) / b);
+}
+
+static inline int32_t fxMod(int32_t a, int32_t b) {
+    // INT32_MIN % -1 traps, every value is a multiple of -1
+    if (b == 0 || b == -1) return 0;
+    return a % b;
+}
+
+static inline uint8_t fxToByte(int32_t v) {
+    if (v <= 0) return 0;
+    if (v >= FX_ONE) return 255;
+    return (uint8_t)((v * 255 + FX_ONE / 2) >> 16);
+}
+
+static inline uint16_t fxToLevel(int32_t v) {
+    if (v <= 0) return 0;
+    if (v >= FX_ONE) return 65535;
+    return (uint16_t)v;
+}
+
+// Parabolic approximation with one refinement step, error below 0.1%
+int32_t fxSin(int32_t turns) {
+    // Map to -0.5..0.5 turns, then to -1..1
+    int32_t t = turns & 0xFFFF;
+    if (t >= FX_ONE / 2) t -= FX_ONE;
+    int32_t u = t * 2;
+
+    int32_t absU = u < 0 ? -u : u;
+    int32_t y = fxMul(4 * u, FX_ONE - absU);
+    int32_t absY = y < 0 ? -y : y;
+    // 0.225 * (y * |y| - y) + y
+    return fxMul(14746, fxMul(y, absY) - y) + y;
+}
+
+static inline uint32_t hashLattice(int32_t i) {
+    uint32_t h = (uint32_t)i * 0x9E3779B1u;
+    h ^= h >> 15;
+    h *= 0x85EBCA77u;
+    h ^= h >> 13;
+    return h;
+}
+
+int32_t fxNoise(int32_t x) {
+    int32_t cell = x >> 16;
+    int32_t f = x & 0xFFFF;
+    int32_t a = hashLattice(cell) & 0xFFFF;
+    int32_t b = hashLattice(cell + 1) & 0xFFFF;
+    // Smoothstep f * f * (3 - 2f)
+    int32_t s = fxMul(fxMul(f, f), 3 * FX_ONE - 2 * f);
+    return a + fxMul(b - a, s);
+}
+
+static int operandSize(uint8_t op) {
+    switch (op) {
+        case OP_PUSH:
+            return 4;
+        case OP_LOAD:
+        case OP_STORE:
+            return 1;
+        case OP_JMP:
+        case OP_JZ:
+            return 2;
+        case OP_END: case OP_DUP: case OP_DROP: case OP_SWAP: case OP_OVER:
+        case OP_ADD: case OP_SUB: case OP_MUL: case OP_DIV: case OP_MOD:
+        case OP_NEG: case OP_ABS: case OP_MIN: case OP_MAX: case OP_FLOOR:
+        case OP_FRACT: case OP_CLAMP: case OP_LT: case OP_GT: case OP_EQ:
+        case OP_NOT: case OP_SIN: case OP_NOISE: case OP_TIME: case OP_INDEX:
+        case OP_COUNT: case OP_POS: case OP_RGBW: case OP_RGB:
+            return 0;
+        default:
+            return -1;
+    }
+}
+
+static inline uint16_t readU16(const uint8_t* p) {
+    return p[0] | (p[1] << 8);
+}
+
+static inline int32_t readI32(const uint8_t* p) {
+    return (int32_t)((uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+}
+
+bool verifyEffectProgram(const uint8_t* data, size_t length, String& error) {
+    if (length < EFFECT_VM_HEADER_SIZE + 1 || length > EFFECT_MAX_PROGRAM_SIZE) {
+        error = "Invalid program size";
+        return false;
+    }
+    if (data[0] != EFFECT_VM_MAGIC_0 || data[1] != EFFECT_VM_MAGIC_1 || data[2] != EFFECT_VM_VERSION) {
+        error = "Invalid program header";
+        return false;
+    }
+
+    const uint8_t* code = data + EFFECT_VM_HEADER_SIZE;
+    size_t codeLength = length - EFFECT_VM_HEADER_SIZE;
+    uint16_t pixelEntry = readU16(data + 3);
+    uint16_t frameEntry = readU16(data + 5);
+
+    // Mark instruction starts, jumps and entries must land on one
+    uint8_t starts[EFFECT_MAX_PROGRAM_SIZE / 8] = {0};
+    size_t pc = 0;
+    while (pc < codeLength) {
+        int size = operandSize(code[pc]);
+        if (size < 0) {
+            error = "Unknown opcode at " + String(pc);
+            return false;
+        }
+        if (pc + 1 + size > codeLength) {
+            error = "Truncated instruction at " + String(pc);
+            return false;
+        }
+        if ((code[pc] == OP_LOAD || code[pc] == OP_STORE) && code[pc + 1] >= EFFECT_VM_REGISTERS) {
+            error = "Invalid register at " + String(pc);
+            return false;
+        }
+        starts[pc / 8] |= 1 << (pc % 8);
+        pc += 1 + size;
+    }
+
+    pc = 0;
+    size_t lastPc = 0;
+    while (pc < codeLength) {
+        uint8_t op = code[pc];
+        if (op == OP_JMP || op == OP_JZ) {
+            uint16_t target = readU16(code + pc + 1);
+            if (target >= codeLength || !(starts[target / 8] & (1 << (target % 8)))) {
+                error = "Invalid jump target at " + String(pc);
+                return false;
+            }
+        }
+        lastPc = pc;
+        pc += 1 + operandSize(op);
+    }
+    // The last instruction must not fall through past the end of the code
+    if (code[lastPc] != OP_END && code[lastPc] != OP_JMP) {
+        error = "Program must end with END or JMP";
+        return false;
+    }
+
+    if (pixelEntry >= codeLength || !(starts[pixelEntry / 8] & (1 << (pixelEntry % 8)))) {
+        error = "Invalid pixel entry";
+        return false;
+    }
+    if (frameEntry != EFFECT_VM_NO_ENTRY &&
+        (frameEntry >= codeLength || !(starts[frameEntry / 8] & (1 << (frameEntry % 8))))) {
+        error = "Invalid frame entry";
+        return false;
+    }
+
+    return true;
+}
+
+ScriptEffect::ScriptEffect()
+    : codeLength(0), pixelEntry(0), frameEntry(EFFECT_VM_NO_ENTRY),
+      resumePixel(0), resuming(false), frameMillis(0), lastInstructions(0), budgetOverruns(0),
+      failed(false) {
+    memset(registers, 0, sizeof(registers));
+}
+
+bool ScriptEffect::load(const uint8_t* data, size_t length) {
+    unload();
+
+    if (!verifyEffectProgram(data, length, error)) {
+        return false;
+    }
+
+    codeLength = length - EFFECT_VM_HEADER_SIZE;
+    memcpy(code, data + EFFECT_VM_HEADER_SIZE, codeLength);
+    pixelEntry = readU16(data + 3);
+    frameEntry = readU16(data + 5);
+    return true;
+}
+
+void ScriptEffect::unload() {
+    codeLength = 0;
+    resumePixel = 0;
+    resuming = false;
+    lastInstructions = 0;
+    budgetOverruns = 0;
+    failed = false;
+    error = "";
+    memset(registers, 0, sizeof(registers));
+}
+
+void ScriptEffect::fail(const char* message) {
+    failed = true;
+    error = message;
+    Serial.printf("Effect script disabled: %s\n", message);
+}
+
+void ScriptEffect::render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) {
+    if (!isLoaded() || count == 0) return;
+
+    Context ctx;
+    ctx.budget = EFFECT_VM_BUDGET;
+    ctx.count = (int32_t)((uint32_t)count << 16);
+
+    // A frame that ran out of budget is finished first, with its own time
+    bool resumed = resuming;
+    if (!resumed) {
+        frameMillis = ms;
+        resumePixel = 0;
+    }
+    ctx.time = (int32_t)((((int64_t)(frameMillis % 32768000UL)) << 16) / 1000);
+
+    if (!resumed && frameEntry != EFFECT_VM_NO_ENTRY) {
+        ctx.index = 0;
+        Result result = execute(frameEntry, ctx);
+        if (result == RESULT_BUDGET) {
+            fail("Instruction budget exceeded in frame entry");
+        }
+        if (result != RESULT_DONE) {
+            lastInstructions = EFFECT_VM_BUDGET - ctx.budget;
+            return;
+        }
+    }
+
+    for (uint16_t i = resumePixel; i < count; i++) {
+        ctx.index = (int32_t)((uint32_t)i << 16);
+        ctx.rgbw[0] = ctx.rgbw[1] = ctx.rgbw[2] = ctx.rgbw[3] = 0;
+
+        Result result = execute(pixelEntry, ctx);
+        if (result == RESULT_BUDGET) {
+            // A pixel that cannot finish with a full budget never will
+            if (resumed && i == resumePixel) {
+                fail("Instruction budget exceeded in pixel entry");
+            } else {
+                resumePixel = i;
+                resuming = true;
+                budgetOverruns++;
+            }
+            lastInstructions = EFFECT_VM_BUDGET - ctx.budget;
+            return;
+        }
+        if (result == RESULT_ERROR) {
+            lastInstructions = EFFECT_VM_BUDGET - ctx.budget;
+            return;
+        }
+
+        frame.setPixelColor(start + i, RgbwColor(ctx.rgbw[0], ctx.rgbw[1], ctx.rgbw[2], ctx.rgbw[3]));
+    }
+
+    resuming = false;
+    lastInstructions = EFFECT_VM_BUDGET - ctx.budget;
+}
+
+#define POP(v)  do { if (sp == 0) goto underflow; v = stack[--sp]; } while (0)
+#define PUSH(v) do { if (sp >= EFFECT_VM_STACK_SIZE) goto overflow; stack[sp++] = (v); } while (0)
+
+ScriptEffect::Result ScriptEffect::execute(uint16_t entry, Context& ctx) {
+    int32_t stack[EFFECT_VM_STACK_SIZE];
+    uint8_t sp = 0;
+    uint16_t pc = entry;
+    int32_t a, b, c, d;
+
+    while (true) {
+        if (ctx.budget == 0) return RESULT_BUDGET;
+        ctx.budget--;
+
+        uint8_t op = code[pc++];
+        switch (op) {
+            case OP_END:
+                return RESULT_DONE;
+            case OP_PUSH:
+                PUSH(readI32(code + pc));
+                pc += 4;
+                break;
+            case OP_DUP:
+                POP(a); PUSH(a); PUSH(a);
+                break;
+            case OP_DROP:
+                POP(a);
+                break;
+            case OP_SWAP:
+                POP(b); POP(a); PUSH(b); PUSH(a);
+                break;
+            case OP_OVER:
+                POP(b); POP(a); PUSH(a); PUSH(b); PUSH(a);
+                break;
+
+            case OP_ADD: POP(b); POP(a); PUSH(fxAdd(a, b)); break;
+            case OP_SUB: POP(b); POP(a); PUSH(fxSub(a, b)); break;
+            case OP_MUL: POP(b); POP(a); PUSH(fxMul(a, b)); break;
+            case OP_DIV: POP(b); POP(a); PUSH(fxDiv(a, b)); break;
+            case OP_MOD: POP(b); POP(a); PUSH(fxMod(a, b)); break;
+            case OP_NEG: POP(a); PUSH(fxNeg(a)); break;
+            case OP_ABS: POP(a); PUSH(a < 0 ? fxNeg(a) : a); break;
+            case OP_MIN: POP(b); POP(a); PUSH(a < b ? a : b); break;
+            case OP_MAX: POP(b); POP(a); PUSH(a > b ? a : b); break;
+            case OP_FLOOR: POP(a); PUSH(a & ~0xFFFF); break;
+            case OP_FRACT: POP(a); PUSH(a & 0xFFFF); break;
+            case OP_CLAMP:
+                POP(a);
+                PUSH(a < 0 ? 0 : (a > FX_ONE ? FX_ONE : a));
+                break;
+
+            case OP_LT: POP(b); POP(a); PUSH(a < b ? FX_ONE : 0); break;
+            case OP_GT: POP(b); POP(a); PUSH(a > b ? FX_ONE : 0); break;
+            case OP_EQ: POP(b); POP(a); PUSH(a == b ? FX_ONE : 0); break;
+            case OP_NOT: POP(a); PUSH(a == 0 ? FX_ONE : 0); break;
+
+            case OP_SIN: POP(a); PUSH(fxSin(a)); break;
+            case OP_NOISE: POP(a); PUSH(fxNoise(a)); break;
+
+            case OP_TIME: PUSH(ctx.time); break;
+            case OP_INDEX: PUSH(ctx.index); break;
+            case OP_COUNT: PUSH(ctx.count); break;
+            case OP_POS:
+                PUSH((int32_t)(((uint64_t)(uint32_t)ctx.index << 16) / (uint32_t)ctx.count));
+                break;
+
+            case OP_LOAD:
+                PUSH(registers[code[pc++]]);
+                break;
+            case OP_STORE:
+                POP(a);
+                registers[code[pc++]] = a;
+                break;
+
+            case OP_JMP:
+                pc = readU16(code + pc);
+                break;
+            case OP_JZ:
+                POP(a);
+                pc = a == 0 ? readU16(code + pc) : pc + 2;
+                break;
+
+            case OP_RGBW:
+                POP(d); POP(c); POP(b); POP(a);
+                ctx.rgbw[0] = fxToByte(a);
+                ctx.rgbw[1] = fxToByte(b);
+                ctx.rgbw[2] = fxToByte(c);
+                ctx.rgbw[3] = fxToByte(d);
+                break;
+            case OP_RGB: {
+                POP(c); POP(b); POP(a);
+                RgbwColor color = LedColor::linearToRgbw(fxToLevel(a), fxToLevel(b), fxToLevel(c));
+                ctx.rgbw[0] = color.R;
+                ctx.rgbw[1] = color.G;
+                ctx.rgbw[2] = color.B;
+                ctx.rgbw[3] = color.W;
+                break;
+            }
+
+            default:
+                // Unreachable for verified programs
+                fail("Invalid opcode");
+                return RESULT_ERROR;
+        }
+    }
+
+underflow:
+    fail("Stack underflow");
+    return RESULT_ERROR;
+overflow:
+    fail("Stack overflow");
+    return RESULT_ERROR;
+}
+
+#undef POP
+#undef PUSH
@@ -0,0 +1,128 @@
+#ifndef EFFECT_VM_H
+#define EFFECT_VM_H
+
+#include <Arduino.h>
+#include "effect.h"
+
+// Maximum size of an uploaded effect program in bytes
+#define EFFECT_MAX_PROGRAM_SIZE 1024
+
+// Instructions a script may execute per frame, frame and pixel entry together
+#ifndef EFFECT_VM_BUDGET
+#define EFFECT_VM_BUDGET 20000
+#endif
+
+#define EFFECT_VM_STACK_SIZE 16
+#define EFFECT_VM_REGISTERS 16
+#define EFFECT_VM_NO_ENTRY 0xFFFF
+
+// Program layout (little endian):
+//   "FX" | version (1) | pixel entry (u16) | frame entry (u16) | code
+// Entries are offsets into the code, the frame entry may be EFFECT_VM_NO_ENTRY.
+#define EFFECT_VM_MAGIC_0 'F'
+#define EFFECT_VM_MAGIC_1 'X'
+#define EFFECT_VM_VERSION 1
+#define EFFECT_VM_HEADER_SIZE 7
+
+// All values are Q16.16 fixed point, 1.0 = 65536. Arithmetic wraps around
+// on overflow.
+enum EffectOpcode : uint8_t {
+    OP_END = 0x00,    // Return from entry
+    OP_PUSH = 0x01,   // Push i32 immediate
+    OP_DUP = 0x02,
+    OP_DROP = 0x03,
+    OP_SWAP = 0x04,
+    OP_OVER = 0x05,
+
+    OP_ADD = 0x10,
+    OP_SUB = 0x11,
+    OP_MUL = 0x12,
+    OP_DIV = 0x13,    // Division by zero gives 0
+    OP_MOD = 0x14,    // Modulo zero gives 0
+    OP_NEG = 0x15,
+    OP_ABS = 0x16,
+    OP_MIN = 0x17,
+    OP_MAX = 0x18,
+    OP_FLOOR = 0x19,
+    OP_FRACT = 0x1A,
+    OP_CLAMP = 0x1B,  // Clamp to 0..1
+
+    OP_LT = 0x20,     // Comparisons push 1.0 or 0
+    OP_GT = 0x21,
+    OP_EQ = 0x22,
+    OP_NOT = 0x23,
+
+    OP_SIN = 0x28,    // Argument in turns, 1.0 = full period
+    OP_NOISE = 0x29,  // 1D value noise, result 0..1
+
+    OP_TIME = 0x30,   // Seconds since boot, wraps after ~9 hours
+    OP_INDEX = 0x31,  // Pixel index within the rendered range
+    OP_COUNT = 0x32,  // Number of pixels in the rendered range
+    OP_POS = 0x33,    // index / count, 0..1
+
+    OP_LOAD = 0x38,   // Push register u8
+    OP_STORE = 0x39,  // Pop into register u8
+
+    OP_JMP = 0x40,    // Jump to u16 code offset
+    OP_JZ = 0x41,     // Pop, jump to u16 code offset if zero
+
+    OP_RGBW = 0x48,   // Pop w, b, g, r (0..1) as pixel color
+    OP_RGB = 0x49     // Pop b, g, r (0..1, linear light), gamma corrected and split onto the white LED
+};
+
+// Fixed point helpers shared by the interpreter and native effects
+int32_t fxSin(int32_t turns);
+int32_t fxNoise(int32_t x);
+
+// Checks header, opcodes, operands and jump targets once at load time,
+// so the interpreter only needs to guard the stack.
+bool verifyEffectProgram(const uint8_t* data, size_t length, String& error);
+
+// Effect running an uploaded bytecode program
+class ScriptEffect : public Effect {
+public:
+    ScriptEffect();
+
+    bool load(const uint8_t* data, size_t length);
+    void unload();
+    bool isLoaded() const { return codeLength > 0 && !failed; }
+    const String& getError() const { return error; }
+
+    const char* getName() const override { return "script"; }
+    void render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) override;
+
+    // Instructions executed in the last render() call
+    uint32_t getLastInstructions() const { return lastInstructions; }
+    // Frames that ran out of budget and were continued in the next frame
+    uint32_t getBudgetOverruns() const { return budgetOverruns; }
+
+private:
+    uint8_t code[EFFECT_MAX_PROGRAM_SIZE];
+    uint16_t codeLength;
+    uint16_t pixelEntry;
+    uint16_t frameEntry;
+
+    int32_t registers[EFFECT_VM_REGISTERS];
+    uint16_t resumePixel;
+    bool resuming;
+    unsigned long frameMillis;
+    uint32_t lastInstructions;
+    uint32_t budgetOverruns;
+    bool failed;
+    String error;
+
+    struct Context {
+        int32_t time;
+        int32_t index;
+        int32_t count;
+        uint8_t rgbw[4];
+        uint32_t budget;
+    };
+
+    enum Result { RESULT_DONE, RESULT_BUDGET, RESULT_ERROR };
+
+    Result execute(uint16_t entry, Context& ctx);
+    void fail(const char* message);
+};
+
+#endif
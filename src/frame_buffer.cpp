@@ -0,0 +1,315 @@
+#include "frame_buffer.h"
+#include <esp_heap_caps.h>
+#include <limits.h>
+
+uint8_t* FrameBuffer::allocate(size_t size) {
+#ifdef BOARD_HAS_PSRAM
+    if (size >= FRAMEBUFFER_PSRAM_THRESHOLD && psramFound()) {
+        void* buffer = heap_caps_malloc(size, MALLOC_CAP_SPIRAM | MALLOC_CAP_8BIT);
+        if (buffer) return (uint8_t*)buffer;
+    }
+#endif
+    return (uint8_t*)malloc(size);
+}
+
+void FrameBuffer::fill(uint16_t start, uint16_t count, const RgbwColor& color) {
+    for (uint16_t i = start; i < pixelCount && i - start < count; i++) {
+        setPixelColor(i, color);
+    }
+}
+
+void FrameBuffer::writePixels(uint16_t start, uint16_t count, const uint8_t* grbw) {
+    for (uint16_t i = start; i < pixelCount && i - start < count; i++, grbw += 4) {
+        setPixelColor(i, RgbwColor(grbw[1], grbw[0], grbw[2], grbw[3]));
+    }
+}
+
+// RgbwFrameBuffer
+
+RgbwFrameBuffer::RgbwFrameBuffer(uint16_t pixelCount)
+    : FrameBuffer(pixelCount), pixels(nullptr) {}
+
+RgbwFrameBuffer::~RgbwFrameBuffer() {
+    free(pixels);
+}
+
+bool RgbwFrameBuffer::begin() {
+    pixels = allocate((size_t)pixelCount * 4);
+    if (!pixels) return false;
+    memset(pixels, 0, (size_t)pixelCount * 4);
+    return true;
+}
+
+void RgbwFrameBuffer::setPixelColor(uint16_t index, const RgbwColor& color) {
+    if (index >= pixelCount) return;
+
+    uint8_t* p = pixels + index * 4;
+    p[0] = color.G;
+    p[1] = color.R;
+    p[2] = color.B;
+    p[3] = color.W;
+}
+
+RgbwColor RgbwFrameBuffer::getPixelColor(uint16_t index) const {
+    if (index >= pixelCount) return RgbwColor(0);
+
+    const uint8_t* p = pixels + index * 4;
+    return RgbwColor(p[1], p[0], p[2], p[3]);
+}
+
+void RgbwFrameBuffer::expand(uint16_t start, uint16_t count, uint8_t* wire) const {
+    memcpy(wire, pixels + start * 4, (size_t)count * 4);
+}
+
+void RgbwFrameBuffer::writePixels(uint16_t start, uint16_t count, const uint8_t* grbw) {
+    if (start >= pixelCount) return;
+    if (count > pixelCount - start) count = pixelCount - start;
+    memcpy(pixels + start * 4, grbw, (size_t)count * 4);
+}
+
+size_t RgbwFrameBuffer::getMemoryUsage() const {
+    return (size_t)pixelCount * 4;
+}
+
+// PaletteFrameBuffer
+
+PaletteFrameBuffer::PaletteFrameBuffer(uint16_t pixelCount)
+    : FrameBuffer(pixelCount), indices(nullptr), paletteUsed(0) {
+    resetPalette();
+}
+
+PaletteFrameBuffer::~PaletteFrameBuffer() {
+    free(indices);
+}
+
+bool PaletteFrameBuffer::begin() {
+    indices = allocate(pixelCount);
+    if (!indices) return false;
+    memset(indices, 0, pixelCount);
+    return true;
+}
+
+// Grid entry of a channel value, levels 0, 85, 170 and 255
+static inline uint8_t gridLevel(uint8_t value) {
+    return (value + 42) / 85;
+}
+
+// Entry = R << 6 | G << 4 | B << 2 | W, so entry 0 is black
+void PaletteFrameBuffer::resetPalette() {
+    for (uint16_t i = 0; i < 256; i++) {
+        palette[i][0] = ((i >> 4) & 3) * 85;
+        palette[i][1] = ((i >> 6) & 3) * 85;
+        palette[i][2] = ((i >> 2) & 3) * 85;
+        palette[i][3] = (i & 3) * 85;
+    }
+    paletteUsed = 0;
+    memset(paletteSet, 0, sizeof(paletteSet));
+}
+
+void PaletteFrameBuffer::setPaletteColor(uint8_t entry, const RgbwColor& color) {
+    palette[entry][0] = color.G;
+    palette[entry][1] = color.R;
+    palette[entry][2] = color.B;
+    palette[entry][3] = color.W;
+    paletteSet[entry >> 5] |= 1u << (entry & 31);
+    if (entry >= paletteUsed) paletteUsed = entry + 1;
+}
+
+RgbwColor PaletteFrameBuffer::getPaletteColor(uint8_t entry) const {
+    const uint8_t* c = palette[entry];
+    return RgbwColor(c[1], c[0], c[2], c[3]);
+}
+
+void PaletteFrameBuffer::setPixelIndex(uint16_t index, uint8_t entry) {
+    if (index < pixelCount) indices[index] = entry;
+}
+
+uint8_t PaletteFrameBuffer::getPixelIndex(uint16_t index) const {
+    return index < pixelCount ? indices[index] : 0;
+}
+
+// Grid entry, or the closest of the entries the effect set. Only reads the
+// palette, so segments may write pixels from both cores.
+uint8_t PaletteFrameBuffer::findColor(const RgbwColor& color) const {
+    if (paletteUsed == 0) {
+        return gridLevel(color.R) << 6 | gridLevel(color.G) << 4 |
+               gridLevel(color.B) << 2 | gridLevel(color.W);
+    }
+
+    uint8_t wanted[4] = { color.G, color.R, color.B, color.W };
+    uint8_t best = 0;
+    int bestDistance = INT_MAX;
+
+    for (uint16_t i = 0; i < paletteUsed; i++) {
+        // Skip grid colors left between the entries the effect set
+        if (!(paletteSet[i >> 5] & (1u << (i & 31)))) continue;
+        int distance = 0;
+        for (uint8_t c = 0; c < 4; c++) {
+            distance += abs((int)palette[i][c] - (int)wanted[c]);
+        }
+        if (distance == 0) return i;
+        if (distance < bestDistance) {
+            bestDistance = distance;
+            best = i;
+        }
+    }
+    return best;
+}
+
+void PaletteFrameBuffer::setPixelColor(uint16_t index, const RgbwColor& color) {
+    if (index >= pixelCount) return;
+    indices[index] = findColor(color);
+}
+
+RgbwColor PaletteFrameBuffer::getPixelColor(uint16_t index) const {
+    if (index >= pixelCount) return RgbwColor(0);
+    return getPaletteColor(indices[index]);
+}
+
+void PaletteFrameBuffer::fill(uint16_t start, uint16_t count, const RgbwColor& color) {
+    if (start >= pixelCount) return;
+    if (count > pixelCount - start) count = pixelCount - start;
+    memset(indices + start, findColor(color), count);
+}
+
+void PaletteFrameBuffer::expand(uint16_t start, uint16_t count, uint8_t* wire) const {
+    const uint8_t* index = indices + start;
+    for (uint16_t i = 0; i < count; i++) {
+        memcpy(wire, palette[index[i]], 4);
+        wire += 4;
+    }
+}
+
+size_t PaletteFrameBuffer::getMemoryUsage() const {
+    return (size_t)pixelCount + sizeof(palette);
+}
+
+// RunLengthFrameBuffer
+
+RunLengthFrameBuffer::RunLengthFrameBuffer(uint16_t pixelCount, uint16_t maxRuns)
+    : FrameBuffer(pixelCount), runs(nullptr), runCount(0),
+      maxRuns(maxRuns < 1 ? 1 : maxRuns), droppedWrites(0) {}
+
+RunLengthFrameBuffer::~RunLengthFrameBuffer() {
+    free(runs);
+}
+
+bool RunLengthFrameBuffer::begin() {
+    runs = (Run*)allocate(maxRuns * sizeof(Run));
+    if (!runs) return false;
+
+    // Single black run over the whole strip
+    runs[0].start = 0;
+    memset(runs[0].grbw, 0, 4);
+    runCount = 1;
+    return true;
+}
+
+// Binary search for the last run starting at or before index
+uint16_t RunLengthFrameBuffer::findRun(uint16_t index) const {
+    uint16_t low = 0;
+    uint16_t high = runCount - 1;
+
+    while (low < high) {
+        uint16_t mid = (low + high + 1) / 2;
+        if (runs[mid].start <= index) {
+            low = mid;
+        } else {
+            high = mid - 1;
+        }
+    }
+    return low;
+}
+
+void RunLengthFrameBuffer::mergeRuns() {
+    uint16_t out = 0;
+    for (uint16_t i = 1; i < runCount; i++) {
+        if (memcmp(runs[i].grbw, runs[out].grbw, 4) != 0) {
+            runs[++out] = runs[i];
+        }
+    }
+    runCount = out + 1;
+}
+
+void RunLengthFrameBuffer::fill(uint16_t start, uint16_t count, const RgbwColor& color) {
+    if (start >= pixelCount || count == 0) return;
+    uint16_t end = count > pixelCount - start ? pixelCount : start + count;
+
+    uint16_t first = findRun(start);
+    uint16_t last = findRun(end - 1);
+
+    // Keep the part of the first run before start, and let the pixels
+    // after end continue with the color of the last replaced run
+    bool keepHead = runs[first].start < start;
+    bool splitTail = end < pixelCount && (last + 1 >= runCount || runs[last + 1].start != end);
+    uint16_t replaced = last - first + 1;
+    uint16_t inserted = (keepHead ? 1 : 0) + 1 + (splitTail ? 1 : 0);
+
+    if (runCount - replaced + inserted > maxRuns) {
+        droppedWrites++;
+        return;
+    }
+
+    Run head = runs[first];
+    Run tail;
+    tail.start = end;
+    memcpy(tail.grbw, runs[last].grbw, 4);
+
+    memmove(&runs[first + inserted], &runs[last + 1], (runCount - last - 1) * sizeof(Run));
+    runCount = runCount - replaced + inserted;
+
+    uint16_t i = first;
+    if (keepHead) runs[i++] = head;
+    runs[i].start = start;
+    runs[i].grbw[0] = color.G;
+    runs[i].grbw[1] = color.R;
+    runs[i].grbw[2] = color.B;
+    runs[i].grbw[3] = color.W;
+    if (splitTail) runs[++i] = tail;
+
+    mergeRuns();
+}
+
+void RunLengthFrameBuffer::setPixelColor(uint16_t index, const RgbwColor& color) {
+    fill(index, 1, color);
+}
+
+RgbwColor RunLengthFrameBuffer::getPixelColor(uint16_t index) const {
+    if (index >= pixelCount) return RgbwColor(0);
+
+    const uint8_t* c = runs[findRun(index)].grbw;
+    return RgbwColor(c[1], c[0], c[2], c[3]);
+}
+
+void RunLengthFrameBuffer::expand(uint16_t start, uint16_t count, uint8_t* wire) const {
+    uint16_t end = start + count;
+    uint16_t run = findRun(start);
+    uint16_t pixel = start;
+
+    while (pixel < end) {
+        uint16_t runEnd = run + 1 < runCount ? runs[run + 1].start : pixelCount;
+        if (runEnd > end) runEnd = end;
+
+        for (; pixel < runEnd; pixel++) {
+            memcpy(wire, runs[run].grbw, 4);
+            wire += 4;
+        }
+        run++;
+    }
+}
+
+size_t RunLengthFrameBuffer::getMemoryUsage() const {
+    return maxRuns * sizeof(Run);
+}
+
+FrameBuffer* createFrameBuffer(FrameBufferFormat format, uint16_t pixelCount) {
+    switch (format) {
+        case FRAMEBUFFER_PALETTE:
+            return new PaletteFrameBuffer(pixelCount);
+        case FRAMEBUFFER_RLE:
+            return new RunLengthFrameBuffer(pixelCount);
+        case FRAMEBUFFER_RGBW:
+        default:
+            return new RgbwFrameBuffer(pixelCount);
+    }
+}
@@ -0,0 +1,152 @@
+#ifndef FRAME_BUFFER_H
+#define FRAME_BUFFER_H
+
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+
+// Framebuffer format: FRAMEBUFFER_RGBW, FRAMEBUFFER_PALETTE or FRAMEBUFFER_RLE
+#ifndef LED_FRAMEBUFFER
+#define LED_FRAMEBUFFER FRAMEBUFFER_RGBW
+#endif
+
+// Maximum number of color runs in FRAMEBUFFER_RLE mode
+#ifndef LED_RLE_MAX_RUNS
+#define LED_RLE_MAX_RUNS 64
+#endif
+
+// Buffers of at least this size go to PSRAM when the board has it
+#define FRAMEBUFFER_PSRAM_THRESHOLD 1024
+
+enum FrameBufferFormat {
+    FRAMEBUFFER_RGBW,     // 4 bytes per LED
+    FRAMEBUFFER_PALETTE,  // 1 byte per LED + 256 entry RGBW palette
+    FRAMEBUFFER_RLE       // Color runs, for mostly uniform scenes
+};
+
+// Logical pixels rendered by effects. Converted to the GRBW wire format
+// only when a frame is sent to the LED outputs.
+class FrameBuffer {
+public:
+    explicit FrameBuffer(uint16_t pixelCount) : pixelCount(pixelCount) {}
+    virtual ~FrameBuffer() {}
+
+    virtual bool begin() = 0;
+    uint16_t getPixelCount() const { return pixelCount; }
+
+    virtual void setPixelColor(uint16_t index, const RgbwColor& color) = 0;
+    virtual RgbwColor getPixelColor(uint16_t index) const = 0;
+    virtual void fill(uint16_t start, uint16_t count, const RgbwColor& color);
+    void clear(const RgbwColor& color = RgbwColor(0)) { fill(0, pixelCount, color); }
+
+    // Write pixels [start, start + count) in GRBW wire order
+    virtual void expand(uint16_t start, uint16_t count, uint8_t* wire) const = 0;
+    // Set pixels [start, start + count) from GRBW wire order
+    virtual void writePixels(uint16_t start, uint16_t count, const uint8_t* grbw);
+
+    // False when writes to different pixels must not happen at the same
+    // time, e.g. from segments rendering on both cores
+    virtual bool supportsParallelWrites() const { return true; }
+
+    virtual size_t getMemoryUsage() const = 0;
+    virtual const char* getFormatName() const = 0;
+
+protected:
+    uint16_t pixelCount;
+
+    static uint8_t* allocate(size_t size);
+};
+
+// Full color, stored in wire order so expanding is a plain copy
+class RgbwFrameBuffer : public FrameBuffer {
+public:
+    explicit RgbwFrameBuffer(uint16_t pixelCount);
+    ~RgbwFrameBuffer();
+
+    bool begin() override;
+    void setPixelColor(uint16_t index, const RgbwColor& color) override;
+    RgbwColor getPixelColor(uint16_t index) const override;
+    void expand(uint16_t start, uint16_t count, uint8_t* wire) const override;
+    void writePixels(uint16_t start, uint16_t count, const uint8_t* grbw) override;
+    size_t getMemoryUsage() const override;
+    const char* getFormatName() const override { return "RGBW"; }
+
+    // GRBW wire order
+    const uint8_t* getPixels() const { return pixels; }
+
+private:
+    uint8_t* pixels;
+};
+
+// 8-bit palette index per LED. The palette belongs to the effect: it sets
+// entries with setPaletteColor() and writes indices with setPixelIndex().
+// Until it does, the palette is a fixed grid of 4 levels per channel and
+// setPixelColor() quantizes to it without a search. The palette never
+// changes by itself, so a color always maps to the same entry.
+class PaletteFrameBuffer : public FrameBuffer {
+public:
+    explicit PaletteFrameBuffer(uint16_t pixelCount);
+    ~PaletteFrameBuffer();
+
+    bool begin() override;
+    void setPixelColor(uint16_t index, const RgbwColor& color) override;
+    RgbwColor getPixelColor(uint16_t index) const override;
+    void fill(uint16_t start, uint16_t count, const RgbwColor& color) override;
+    void expand(uint16_t start, uint16_t count, uint8_t* wire) const override;
+    size_t getMemoryUsage() const override;
+    const char* getFormatName() const override { return "Palette"; }
+
+    // Replaces the grid, setPixelColor() then searches the nearest of the
+    // entries set so far
+    void setPaletteColor(uint8_t entry, const RgbwColor& color);
+    RgbwColor getPaletteColor(uint8_t entry) const;
+    void resetPalette();
+    void setPixelIndex(uint16_t index, uint8_t entry);
+    uint8_t getPixelIndex(uint16_t index) const;
+
+private:
+    uint8_t* indices;
+    uint8_t palette[256][4];  // GRBW
+    uint16_t paletteUsed;     // Highest entry set by the effect + 1, 0 while the grid is used
+    uint32_t paletteSet[8];   // Bit per entry set by the effect, the others still hold the grid
+
+    uint8_t findColor(const RgbwColor& color) const;
+};
+
+// Sorted list of color runs, each run lasts until the next one starts.
+// Writes that would need more than LED_RLE_MAX_RUNS runs are dropped.
+class RunLengthFrameBuffer : public FrameBuffer {
+public:
+    explicit RunLengthFrameBuffer(uint16_t pixelCount, uint16_t maxRuns = LED_RLE_MAX_RUNS);
+    ~RunLengthFrameBuffer();
+
+    bool begin() override;
+    void setPixelColor(uint16_t index, const RgbwColor& color) override;
+    RgbwColor getPixelColor(uint16_t index) const override;
+    void fill(uint16_t start, uint16_t count, const RgbwColor& color) override;
+    void expand(uint16_t start, uint16_t count, uint8_t* wire) const override;
+    size_t getMemoryUsage() const override;
+    const char* getFormatName() const override { return "RLE"; }
+    // Every write may move the runs
+    bool supportsParallelWrites() const override { return false; }
+
+    uint16_t getRunCount() const { return runCount; }
+    unsigned long getDroppedWrites() const { return droppedWrites; }
+
+private:
+    struct Run {
+        uint16_t start;
+        uint8_t grbw[4];
+    };
+
+    Run* runs;
+    uint16_t runCount;
+    uint16_t maxRuns;
+    unsigned long droppedWrites;
+
+    uint16_t findRun(uint16_t index) const;
+    void mergeRuns();
+};
+
+FrameBuffer* createFrameBuffer(FrameBufferFormat format, uint16_t pixelCount);
+
+#endif
@@ -1,12 +1,46 @@
 #include "homeServer.h"
-#include "web_material.h"
+#include "home_material.h"
+#include "web_assets.h"
+#include "effect_vm.h"
+#include "effect_store.h"
+#include "log_buffer.h"
+#include "web_admission.h"
+#include "json_response.h"
+#include "device_state.h"
+#include "profiler.h"
 #include <WiFi.h>
+#include <esp_wifi.h>
 
-String getHomeHTML() {
-    String html = MaterialPage::getHeader("Smart Home Light");
-    html += MaterialPage::getAppBar("Smart Home Light", "WiFi Connected");
-    html += MaterialPage::getFooter();
-    return html;
+// Snapshot of everything /api/state reports, without allocating
+static void collectDeviceState(DeviceState& state) {
+    state.light = getLightState();
+
+    wifi_ap_record_t ap;
+    state.wifi.connected = WiFi.status() == WL_CONNECTED && esp_wifi_sta_get_ap_info(&ap) == ESP_OK;
+    state.wifi.portal = false;  // The home server only runs in station mode
+    if (state.wifi.connected) {
+        memcpy(state.wifi.ssid, ap.ssid, sizeof(state.wifi.ssid));
+        state.wifi.rssi = ap.rssi;
+    } else {
+        state.wifi.ssid[0] = '\0';
+        state.wifi.rssi = 0;
+    }
+    IPAddress ip = WiFi.localIP();
+    for (uint8_t i = 0; i < 4; i++) {
+        state.wifi.ip[i] = ip[i];
+    }
+
+    const AdmissionStats& web = getAdmissionStats();
+    state.system.uptimeSeconds = millis() / 1000;
+    state.system.freeHeap = ESP.getFreeHeap();
+    state.system.minFreeHeap = ESP.getMinFreeHeap();
+    state.system.largestFreeBlock = ESP.getMaxAllocHeap();
+    state.system.freePsram = ESP.getFreePsram();
+    state.system.logDropped = getLogDropped();
+    state.system.webAdmitted = web.admitted;
+    state.system.webRejected = web.rejectedBusy + web.rejectedHeap;
+
+    state.sync = getSyncState();
 }
 
 void setupHomeServer(AsyncWebServer*& server) {
@@ -16,14 +50,116 @@ void setupHomeServer(AsyncWebServer*& server) {
 
     server = new AsyncWebServer(80);
 
+    // 503 when too busy or low on heap, before any route
+    addAdmissionControl(server);
+
     // Get home HTML once
     String homeHTML = getHomeHTML();
 
     // Serve homepage at root
     server->on("/", HTTP_GET, [homeHTML](AsyncWebServerRequest *request) {
+        PROFILE_SCOPE(PROFILE_HTTP_PAGE);
         request->send(200, "text/html", homeHTML);
     });
 
+    // Stylesheet linked by the pages, cached by the browser
+    registerMaterialAssets(server);
+
+    // Machine-readable state, polled often by home automation. Written once
+    // into the response's own buffer, no String is built
+    server->on("/api/state", HTTP_GET, [](AsyncWebServerRequest *request) {
+        PROFILE_SCOPE(PROFILE_HTTP_STATE);
+        DeviceState state;
+        collectDeviceState(state);
+
+        JsonResponse<STATE_JSON_SIZE>* response = new JsonResponse<STATE_JSON_SIZE>();
+        writeStateJSON(response->json(), state);
+        response->addHeader("Cache-Control", "no-store");
+        request->send(response);
+    });
+
+#if LAMP_SYNC
+    // Start a scene on all lamps, ?delay=ms from now, DELETE ends it, see docs/LAMP_SYNC.md
+    server->on("/api/scene", HTTP_POST, [](AsyncWebServerRequest *request) {
+        long delayMillis = SYNC_SCENE_DELAY;
+        if (request->hasParam("delay")) {
+            delayMillis = request->getParam("delay")->value().toInt();
+        }
+        if (delayMillis < 0 || delayMillis > 60000) {
+            request->send(400, "application/json", "{\"success\":false,\"message\":\"delay must be 0..60000 ms\"}");
+            return;
+        }
+
+        requestScene(delayMillis);
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+    server->on("/api/scene", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        requestSceneEnd();
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+#endif
+
+    // Recent log lines
+    server->on("/api/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", getLogHistory());
+    });
+
+#if PROFILING
+    // Task and section profile, see docs/PROFILING.md
+    server->on("/api/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", getProfileReport());
+    });
+    server->on("/api/profile", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        resetProfile();
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+#endif
+
+    // Upload an effect program, see tools/effect_asm.py
+    server->on("/api/effect", HTTP_POST, [](AsyncWebServerRequest *request) {
+        PROFILE_SCOPE(PROFILE_HTTP_EFFECT);
+        uint8_t* program = (uint8_t*)request->_tempObject;
+        size_t length = request->contentLength();
+
+        if (!program) {
+            request->send(400, "application/json", "{\"success\":false,\"message\":\"Program missing or too large\"}");
+            return;
+        }
+
+        String error;
+        if (!verifyEffectProgram(program, length, error)) {
+            // The message is escaped by the writer
+            JsonResponse<128>* response = new JsonResponse<128>(400);
+            response->json().beginObject();
+            response->json().member("success", false);
+            response->json().member("message", error);
+            response->json().endObject();
+            request->send(response);
+            return;
+        }
+
+        if (!saveEffectProgram(program, length)) {
+            request->send(500, "application/json", "{\"success\":false,\"message\":\"Failed to store program\"}");
+            return;
+        }
+
+        request->send(200, "application/json", "{\"success\":true}");
+    }, nullptr, [](AsyncWebServerRequest *request, uint8_t *data, size_t len, size_t index, size_t total) {
+        // Collect the body, freed together with the request
+        if (index == 0 && total <= EFFECT_MAX_PROGRAM_SIZE) {
+            request->_tempObject = malloc(total);
+        }
+        if (request->_tempObject && index + len <= total) {
+            memcpy((uint8_t*)request->_tempObject + index, data, len);
+        }
+    });
+
+    // Remove the uploaded effect program
+    server->on("/api/effect", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        clearEffectProgram();
+        request->send(200, "application/json", "{\"success\":true}");
+    });
+
     server->begin();
     Serial.println("Home web server started");
     Serial.printf("Access at: http://%s\n", WiFi.localIP().toString().c_str());
@@ -7,7 +7,4 @@
 // Setup the home web server when connected to WiFi
 void setupHomeServer(AsyncWebServer*& server);
 
-// Generate the home page HTML
-String getHomeHTML();
-
 #endif
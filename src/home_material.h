@@ -0,0 +1,15 @@
+#ifndef HOME_MATERIAL_H
+#define HOME_MATERIAL_H
+
+#include <Arduino.h>
+#include "web_material.h"
+
+// Home page HTML, served when connected to WiFi
+String getHomeHTML() {
+    String html = MaterialPage::getHeader("Smart Home Light");
+    html += MaterialPage::getAppBar("Smart Home Light", "WiFi Connected");
+    html += MaterialPage::getFooter();
+    return html;
+}
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef JSON_RESPONSE_H
+#define JSON_RESPONSE_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "json_writer.h"
+
+// Response owning a fixed JSON buffer. The document is written once into
+// the response object the server allocates anyway and sent from there,
+// without a String copy:
+//
+//   JsonResponse<512>* response = new JsonResponse<512>();
+//   response->json().beginObject();
+//   ...
+//   request->send(response);
+//
+// A document larger than the buffer is answered with 500.
+template <size_t T_SIZE>
+class JsonResponse : public AsyncAbstractResponse {
+public:
+    explicit JsonResponse(int code = 200) : writer(buffer, T_SIZE), sent(0) {
+        _code = code;
+        _contentType = "application/json";
+    }
+
+    JsonWriter& json() { return writer; }
+
+    bool _sourceValid() const override { return !writer.overflowed(); }
+
+    void _respond(AsyncWebServerRequest *request) override {
+        _contentLength = writer.length();
+        AsyncAbstractResponse::_respond(request);
+    }
+
+    size_t _fillBuffer(uint8_t *data, size_t len) override {
+        size_t left = _contentLength - sent;
+        if (len > left) len = left;
+        memcpy(data, buffer + sent, len);
+        sent += len;
+        return len;
+    }
+
+private:
+    char buffer[T_SIZE];
+    JsonWriter writer;
+    size_t sent;
+};
+
+#endif
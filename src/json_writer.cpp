@@ -0,0 +1,191 @@
+#include "json_writer.h"
+
+static const char HEX_DIGITS[] = "0123456789abcdef";
+
+JsonWriter::JsonWriter(char* buffer, size_t size, size_t offset)
+    : buffer(buffer), size(size), offset(offset), position(0),
+      hasItems(0), depth(0), afterKey(false) {}
+
+size_t JsonWriter::written() const {
+    if (position <= offset) {
+        return 0;
+    }
+    size_t stored = position - offset;
+    return stored < size ? stored : size;
+}
+
+void JsonWriter::put(const char* text) {
+    while (*text) {
+        put(*text++);
+    }
+}
+
+// Comma before every value of an object or array but the first
+void JsonWriter::separate() {
+    if (afterKey) {
+        afterKey = false;
+        return;
+    }
+    if (depth == 0) {
+        return;
+    }
+
+    uint32_t bit = 1u << (depth - 1);
+    if (hasItems & bit) {
+        put(',');
+    }
+    hasItems |= bit;
+}
+
+void JsonWriter::open(char bracket) {
+    separate();
+    put(bracket);
+    if (depth < JSON_MAX_DEPTH) {
+        depth++;
+        hasItems &= ~(1u << (depth - 1));
+    }
+}
+
+void JsonWriter::close(char bracket) {
+    if (depth > 0) {
+        depth--;
+    }
+    put(bracket);
+}
+
+void JsonWriter::beginObject() {
+    open('{');
+}
+
+void JsonWriter::endObject() {
+    close('}');
+}
+
+void JsonWriter::beginArray() {
+    open('[');
+}
+
+void JsonWriter::endArray() {
+    close(']');
+}
+
+void JsonWriter::key(const char* name) {
+    separate();
+    writeString(name, strlen(name));
+    put(':');
+    afterKey = true;
+}
+
+void JsonWriter::value(const char* text) {
+    if (!text) {
+        nullValue();
+        return;
+    }
+    value(text, strlen(text));
+}
+
+void JsonWriter::value(const char* text, size_t length) {
+    separate();
+    writeString(text, length);
+}
+
+void JsonWriter::value(bool flag) {
+    separate();
+    put(flag ? "true" : "false");
+}
+
+void JsonWriter::nullValue() {
+    separate();
+    put("null");
+}
+
+void JsonWriter::writeNumber(unsigned long long number, bool negative) {
+    separate();
+
+    char digits[21];
+    uint8_t count = 0;
+    do {
+        digits[count++] = '0' + number % 10;
+        number /= 10;
+    } while (number > 0);
+
+    if (negative) {
+        put('-');
+    }
+    while (count > 0) {
+        put(digits[--count]);
+    }
+}
+
+// Length of the valid UTF-8 sequence at text, 0 if invalid
+static size_t utf8Sequence(const uint8_t* text, size_t length) {
+    uint8_t lead = text[0];
+    size_t count;
+    uint8_t min = 0x80, max = 0xBF;  // Range of the second byte
+
+    if (lead >= 0xC2 && lead <= 0xDF) {
+        count = 2;
+    } else if (lead >= 0xE0 && lead <= 0xEF) {
+        count = 3;
+        if (lead == 0xE0) min = 0xA0;  // Overlong
+        if (lead == 0xED) max = 0x9F;  // Surrogates
+    } else if (lead >= 0xF0 && lead <= 0xF4) {
+        count = 4;
+        if (lead == 0xF0) min = 0x90;  // Overlong
+        if (lead == 0xF4) max = 0x8F;  // Above U+10FFFF
+    } else {
+        return 0;
+    }
+
+    if (count > length || text[1] < min || text[1] > max) {
+        return 0;
+    }
+    for (size_t i = 2; i < count; i++) {
+        if (text[i] < 0x80 || text[i] > 0xBF) {
+            return 0;
+        }
+    }
+    return count;
+}
+
+void JsonWriter::writeString(const char* text, size_t length) {
+    const uint8_t* bytes = (const uint8_t*)text;
+    put('"');
+
+    for (size_t i = 0; i < length; i++) {
+        uint8_t c = bytes[i];
+
+        if (c >= 0x80) {
+            size_t count = utf8Sequence(bytes + i, length - i);
+            if (count == 0) {
+                put("\\ufffd");
+                continue;
+            }
+            for (size_t j = 0; j < count; j++) {
+                put((char)bytes[i + j]);
+            }
+            i += count - 1;
+            continue;
+        }
+
+        switch (c) {
+            case '"':  put("\\\""); break;
+            case '\\': put("\\\\"); break;
+            case '\n': put("\\n"); break;
+            case '\r': put("\\r"); break;
+            case '\t': put("\\t"); break;
+            case '\b': put("\\b"); break;
+            case '\f': put("\\f"); break;
+            default:
+                if (c < 0x20) {
+                    put("\\u00");
+                    put(HEX_DIGITS[c >> 4]);
+                    put(HEX_DIGITS[c & 0x0F]);
+                } else {
+                    put((char)c);
+                }
+        }
+    }
+
+    put('"');
+}
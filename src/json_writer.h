@@ -0,0 +1,90 @@
+#ifndef JSON_WRITER_H
+#define JSON_WRITER_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+#define JSON_MAX_DEPTH 16
+
+// Streaming JSON writer into a fixed buffer, never allocates.
+//
+// Strings are escaped, invalid UTF-8 (e.g. in SSIDs) becomes U+FFFD.
+// With an offset the writer keeps only the bytes [offset, offset + size)
+// of the document, so a chunked response can render the document again for
+// every chunk instead of keeping state between chunks:
+//
+//   JsonWriter json((char*)buffer, maxLen, index);
+//   json.beginObject();
+//   json.member("rssi", -60);
+//   json.endObject();
+//   return json.written();
+class JsonWriter {
+public:
+    JsonWriter(char* buffer, size_t size, size_t offset = 0);
+
+    void beginObject();
+    void endObject();
+    void beginArray();
+    void endArray();
+
+    // Name of the next object member, followed by a value or begin
+    void key(const char* name);
+
+    void value(const char* text);
+    void value(const char* text, size_t length);
+    void value(const String& text) { value(text.c_str(), text.length()); }
+    void value(bool flag);
+    void nullValue();
+
+    template <typename T>
+    typename std::enable_if<std::is_integral<T>::value && !std::is_same<T, bool>::value>::type
+    value(T number) {
+        if constexpr (std::is_signed<T>::value) {
+            if (number < 0) {
+                writeNumber(0ull - (unsigned long long)number, true);
+                return;
+            }
+        }
+        writeNumber((unsigned long long)number, false);
+    }
+
+    template <typename T>
+    void member(const char* name, const T& v) {
+        key(name);
+        value(v);
+    }
+
+    // Document length so far, including skipped and cut off bytes
+    size_t length() const { return position; }
+    // Bytes stored in the buffer
+    size_t written() const;
+    // The buffer is complete, further output is only counted
+    bool full() const { return position >= offset + size; }
+    // The document did not fit into a buffer starting at offset 0
+    bool overflowed() const { return offset == 0 && position > size; }
+
+private:
+    char* buffer;
+    size_t size;
+    size_t offset;
+    size_t position;
+
+    uint32_t hasItems;  // Bit per depth: a value was written at this level
+    uint8_t depth;
+    bool afterKey;
+
+    void put(char c) {
+        if (position >= offset && position - offset < size) {
+            buffer[position - offset] = c;
+        }
+        position++;
+    }
+    void put(const char* text);
+    void separate();
+    void open(char bracket);
+    void close(char bracket);
+    void writeString(const char* text, size_t length);
+    void writeNumber(unsigned long long number, bool negative);
+};
+
+#endif
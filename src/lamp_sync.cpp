@@ -0,0 +1,568 @@
+#include "lamp_sync.h"
+#include "log_buffer.h"
+#include <lwip/sockets.h>
+
+#define SYNC_TASK_STACK 3072
+#define SYNC_TASK_PRIORITY 2    // Above the Arduino loop, so receive times are taken right away
+#define SYNC_POLL_MS 10         // Receive timeout, period of the timed work
+#define SYNC_DELAY_SLACK 500    // Microseconds a sample may be slower than the fastest recent one
+#define SYNC_MAX_RATE 0.0005    // 500 ppm, far beyond any crystal
+#define SYNC_SYNCED_SAMPLES 3
+#define SYNC_VERSION 1
+
+enum SyncMessageType : uint8_t {
+    SYNC_MSG_SYNC = 1,            // Master -> all: time = t1
+    SYNC_MSG_DELAY_REQUEST,       // Follower -> master: error and delay of the follower
+    SYNC_MSG_DELAY_RESPONSE,      // Master -> follower: time = t4
+    SYNC_MSG_SCENE,               // Any -> all: time = scene start in shared time
+    SYNC_MSG_SCENE_END            // Any -> all: number = scene to end
+};
+
+// All messages have the same layout, little endian on every ESP32 and x86
+struct __attribute__((packed)) SyncMessage {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t type;
+    uint32_t sender;
+    uint32_t target;    // Delay response: the follower that asked
+    uint32_t number;    // Delay request and response: sequence, scene: scene number
+    int64_t time;
+    int32_t errorMicros;
+    uint32_t delayMicros;
+};
+
+static portMUX_TYPE syncLock = portMUX_INITIALIZER_UNLOCKED;
+static uint32_t sceneRequest = 0;  // Requested delay + 1, 0 when none
+static bool sceneEndRequest = false;
+
+void requestScene(uint32_t delayMillis) {
+    __atomic_store_n(&sceneRequest, delayMillis + 1, __ATOMIC_RELEASE);
+}
+
+void requestSceneEnd() {
+    __atomic_store_n(&sceneEndRequest, true, __ATOMIC_RELEASE);
+}
+
+// Lamp ids in log messages, hex like the MAC they come from
+struct SyncIdText {
+    char text[9];
+    explicit SyncIdText(uint32_t id) { snprintf(text, sizeof(text), "%08x", (unsigned)id); }
+};
+
+const char* getSyncRoleName(SyncRole role) {
+    switch (role) {
+        case SYNC_LISTENING: return "listening";
+        case SYNC_FOLLOWER: return "follower";
+        case SYNC_MASTER: return "master";
+        case SYNC_OFF:
+        default: return "off";
+    }
+}
+
+LampSync::LampSync()
+    : sock(-1), running(false), active(false), task(nullptr), clock(nullptr), id(0), groupAddress(0),
+      offset(0), reference(0), rate(0.0), sceneActive(false), sceneStart(0) {
+    memset(&state, 0, sizeof(state));
+}
+
+LampSync::~LampSync() {
+    stop();
+    // The task uses this object until it has closed its socket
+    while (active) {
+        delay(SYNC_POLL_MS);
+    }
+}
+
+bool LampSync::begin(uint32_t lampId, SyncClock localClock, uint32_t interfaceAddress) {
+    // The task of a previous run closes its socket and ends on its own
+    if (active) {
+        return false;
+    }
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+    if (sock < 0) {
+        return false;
+    }
+
+    // Several lamp instances on one host share the port
+    int reuse = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    struct sockaddr_in local;
+    memset(&local, 0, sizeof(local));
+    local.sin_family = AF_INET;
+    local.sin_port = htons(SYNC_PORT);
+    local.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    groupAddress = inet_addr(SYNC_GROUP);
+    struct ip_mreq membership;
+    membership.imr_multiaddr.s_addr = groupAddress;
+    membership.imr_interface.s_addr = interfaceAddress;
+
+    struct in_addr outgoing;
+    outgoing.s_addr = interfaceAddress;
+
+    // Receive timeout paces the timed work of the task
+    struct timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = SYNC_POLL_MS * 1000;
+
+    if (bind(sock, (struct sockaddr*)&local, sizeof(local)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_ADD_MEMBERSHIP, &membership, sizeof(membership)) < 0 ||
+        setsockopt(sock, IPPROTO_IP, IP_MULTICAST_IF, &outgoing, sizeof(outgoing)) < 0 ||
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout)) < 0) {
+        close(sock);
+        sock = -1;
+        return false;
+    }
+
+    id = lampId;
+    clock = localClock;
+    role = SYNC_LISTENING;
+    master = 0;
+    sequence = 0;
+    requestPending = false;
+    delayIndex = 0;
+    delayCount = 0;
+    sceneNumber = 0;
+    sceneSender = 0;
+    sceneRepeat = 0;
+    sceneEndRepeat = 0;
+
+    int64_t now = clock();
+    listenStart = now;
+    lastMasterSync = now;
+    nextSync = now;
+
+    portENTER_CRITICAL(&syncLock);
+    offset = 0;
+    reference = now;
+    rate = 0.0;
+    memset(&state, 0, sizeof(state));
+    state.role = role;
+    state.id = id;
+    portEXIT_CRITICAL(&syncLock);
+
+    running = true;
+    active = true;
+    if (xTaskCreate(taskMain, "sync", SYNC_TASK_STACK, this, SYNC_TASK_PRIORITY, &task) != pdPASS) {
+        running = false;
+        active = false;
+        close(sock);
+        sock = -1;
+        return false;
+    }
+    return true;
+}
+
+void LampSync::stop() {
+    // The task notices within SYNC_POLL_MS
+    running = false;
+}
+
+void LampSync::taskMain(void* parameter) {
+    ((LampSync*)parameter)->run();
+}
+
+void LampSync::run() {
+    uint8_t buffer[sizeof(SyncMessage)];
+
+    while (running) {
+        int length = recv(sock, buffer, sizeof(buffer), 0);
+        int64_t now = clock();
+
+        if (length > 0) {
+            handleMessage(buffer, length, now);
+        }
+        update(now);
+    }
+
+    close(sock);
+    sock = -1;
+
+    portENTER_CRITICAL(&syncLock);
+    state.role = SYNC_OFF;
+    sceneActive = false;
+    portEXIT_CRITICAL(&syncLock);
+
+    active = false;
+    vTaskDelete(nullptr);
+}
+
+int64_t LampSync::toShared(int64_t localMicros) const {
+    portENTER_CRITICAL(&syncLock);
+    int64_t modelOffset = offset;
+    int64_t modelReference = reference;
+    double modelRate = rate;
+    portEXIT_CRITICAL(&syncLock);
+
+    return localMicros + modelOffset + (int64_t)(modelRate * (localMicros - modelReference));
+}
+
+bool LampSync::getSceneMillis(int64_t localMicros, uint32_t& sceneMillis) const {
+    portENTER_CRITICAL(&syncLock);
+    bool active = sceneActive;
+    int64_t start = sceneStart;
+    portEXIT_CRITICAL(&syncLock);
+
+    if (!active) {
+        return false;
+    }
+    int64_t elapsed = toShared(localMicros) - start;
+    if (elapsed < 0) {
+        return false;
+    }
+    sceneMillis = elapsed / 1000;
+    return true;
+}
+
+bool LampSync::getSceneFrameWait(int64_t localMicros, uint32_t frameMillis, uint32_t& waitMicros) const {
+    portENTER_CRITICAL(&syncLock);
+    bool active = sceneActive;
+    int64_t start = sceneStart;
+    portEXIT_CRITICAL(&syncLock);
+
+    if (!active) {
+        return false;
+    }
+    int64_t elapsed = toShared(localMicros) - start;
+    int64_t period = (int64_t)frameMillis * 1000;
+    // Before the start the first frame is the start itself
+    int64_t wait = elapsed < 0 ? -elapsed : period - elapsed % period;
+    waitMicros = wait < UINT32_MAX ? (uint32_t)wait : UINT32_MAX;
+    return true;
+}
+
+bool LampSync::isSceneRunning() const {
+    portENTER_CRITICAL(&syncLock);
+    bool active = sceneActive;
+    portEXIT_CRITICAL(&syncLock);
+    return active;
+}
+
+void LampSync::getState(SyncState& copy) const {
+    portENTER_CRITICAL(&syncLock);
+    copy = state;
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::handleMessage(const uint8_t* data, int length, int64_t now) {
+    if (length != sizeof(SyncMessage)) {
+        return;
+    }
+
+    SyncMessage message;
+    memcpy(&message, data, sizeof(message));
+    if (message.magic[0] != 'L' || message.magic[1] != 'S' ||
+        message.version != SYNC_VERSION || message.sender == id) {
+        return;
+    }
+
+    switch (message.type) {
+        case SYNC_MSG_SYNC:
+            // The lowest id wins, a better master takes over from us
+            if (message.sender != master) {
+                if (master != 0 && message.sender > master) {
+                    return;
+                }
+                follow(message.sender, now);
+            }
+            lastMasterSync = now;
+
+            // Answer right away, the offset should not change between t2 and t3
+            syncTime = message.time;
+            syncReceived = now;
+            requestPending = true;
+            sequence++;
+            requestSent = clock();
+            send(SYNC_MSG_DELAY_REQUEST, master, sequence, 0);
+            break;
+
+        case SYNC_MSG_DELAY_REQUEST:
+            if (role == SYNC_MASTER) {
+                send(SYNC_MSG_DELAY_RESPONSE, message.sender, message.number, toShared(now));
+                updatePeer(message.sender, message.errorMicros, message.delayMicros, now);
+            }
+            break;
+
+        case SYNC_MSG_DELAY_RESPONSE:
+            if (message.target == id && message.sender == master &&
+                requestPending && message.number == sequence) {
+                requestPending = false;
+
+                // offset = master - local, with the same delay both ways
+                int64_t down = syncTime - syncReceived;       // offset - delay
+                int64_t up = message.time - requestSent;      // offset + delay
+                addSample(requestSent, (down + up) / 2, (up - down) / 2);
+            }
+            break;
+
+        case SYNC_MSG_SCENE:
+            if (message.sender != sceneSender || message.number != sceneNumber) {
+                sceneSender = message.sender;
+                sceneNumber = message.number;
+
+                portENTER_CRITICAL(&syncLock);
+                sceneActive = true;
+                sceneStart = message.time;
+                portEXIT_CRITICAL(&syncLock);
+
+                logEvent(LOG_SYNC_SCENE, SyncIdText(message.sender).text,
+                         (int32_t)((message.time - toShared(now)) / 1000));
+            }
+            break;
+
+        case SYNC_MSG_SCENE_END:
+            // Only the scene it was sent for, an older end must not stop a newer scene
+            if (message.number == sceneNumber && isSceneRunning()) {
+                endScene(message.sender);
+            }
+            break;
+    }
+}
+
+void LampSync::update(int64_t now) {
+    int64_t timeout = (int64_t)SYNC_MASTER_TIMEOUT * SYNC_INTERVAL_MS * 1000;
+
+    if (role == SYNC_FOLLOWER && now - lastMasterSync > timeout) {
+        // Master gone, the next best lamp takes over after listening
+        logEvent(LOG_SYNC_MASTER_LOST, SyncIdText(master).text);
+        master = 0;
+        role = SYNC_LISTENING;
+        listenStart = now;
+
+        portENTER_CRITICAL(&syncLock);
+        state.role = role;
+        state.master = 0;
+        state.synced = false;
+        portEXIT_CRITICAL(&syncLock);
+    }
+
+    if (role == SYNC_LISTENING && now - listenStart > timeout) {
+        becomeMaster(now);
+    } else if (role == SYNC_FOLLOWER && master > id && now - listenStart > timeout) {
+        // Followed a worse master to get its time, now take over
+        becomeMaster(now);
+    }
+
+    if (role == SYNC_MASTER && now >= nextSync) {
+        nextSync = now + SYNC_INTERVAL_MS * 1000;
+        send(SYNC_MSG_SYNC, 0, 0, toShared(clock()));
+    }
+
+    uint32_t request = __atomic_exchange_n(&sceneRequest, 0, __ATOMIC_ACQ_REL);
+    if (request != 0) {
+        startScene(now, request - 1);
+    }
+
+    if (__atomic_exchange_n(&sceneEndRequest, false, __ATOMIC_ACQ_REL) && isSceneRunning()) {
+        endScene(id);
+        sceneRepeat = 0;
+        sceneEndRepeat = SYNC_SCENE_REPEAT;
+    }
+
+    if (sceneRepeat > 0) {
+        sceneRepeat--;
+        portENTER_CRITICAL(&syncLock);
+        int64_t start = sceneStart;
+        portEXIT_CRITICAL(&syncLock);
+        send(SYNC_MSG_SCENE, 0, sceneNumber, start);
+    }
+
+    if (sceneEndRepeat > 0) {
+        sceneEndRepeat--;
+        send(SYNC_MSG_SCENE_END, 0, sceneNumber, 0);
+    }
+
+    // Forget followers that stopped asking
+    portENTER_CRITICAL(&syncLock);
+    for (uint8_t i = 0; i < state.peerCount;) {
+        if (now - peerSeen[i] > timeout || role != SYNC_MASTER) {
+            state.peerCount--;
+            state.peers[i] = state.peers[state.peerCount];
+            peerSeen[i] = peerSeen[state.peerCount];
+        } else {
+            i++;
+        }
+    }
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::addSample(int64_t local, int64_t measured, int64_t delay) {
+    // WiFi retries and power save only ever add delay, a sample much slower
+    // than the fastest recent one had an asymmetric path
+    if (delay < 0) {
+        delay = 0;
+    }
+    delays[delayIndex] = delay > UINT32_MAX ? UINT32_MAX : (uint32_t)delay;
+    delayIndex = (delayIndex + 1) % SYNC_DELAY_WINDOW;
+    if (delayCount < SYNC_DELAY_WINDOW) {
+        delayCount++;
+    }
+
+    uint32_t minDelay = UINT32_MAX;
+    for (uint8_t i = 0; i < delayCount; i++) {
+        if (delays[i] < minDelay) minDelay = delays[i];
+    }
+
+    if (delay > (int64_t)minDelay + SYNC_DELAY_SLACK) {
+        portENTER_CRITICAL(&syncLock);
+        state.rejected++;
+        portEXIT_CRITICAL(&syncLock);
+        return;
+    }
+
+    // Only this task writes the model, reading it without the lock is safe
+    int64_t elapsed = local - reference;
+    int64_t predicted = offset + (int64_t)(rate * elapsed);
+    int64_t error = measured - predicted;
+
+    int64_t newOffset;
+    double newRate = rate;
+    bool step = state.samples == 0 || error > SYNC_STEP_MICROS || error < -SYNC_STEP_MICROS;
+    if (step) {
+        // First sample or far off, e.g. a new master: step
+        newOffset = measured;
+        if (state.samples > 0) {
+            logEvent(LOG_SYNC_STEP, (int32_t)(error / 1000));
+        }
+    } else {
+        // PI controller: move halfway to the sample, correct the rate by
+        // a tenth of the error over the interval
+        newOffset = predicted + error / 2;
+        if (elapsed > 0) {
+            newRate += 0.1 * (double)error / (double)elapsed;
+            if (newRate > SYNC_MAX_RATE) newRate = SYNC_MAX_RATE;
+            if (newRate < -SYNC_MAX_RATE) newRate = -SYNC_MAX_RATE;
+        }
+    }
+
+    uint32_t absError = error < 0 ? (uint32_t)-error : (uint32_t)error;
+
+    portENTER_CRITICAL(&syncLock);
+    offset = newOffset;
+    reference = local;
+    rate = newRate;
+
+    state.errorMicros = (int32_t)error;
+    // Steps are not jitter, they only start the average again
+    if (step) {
+        state.jitterMicros = 0;
+    } else {
+        state.jitterMicros = state.jitterMicros - state.jitterMicros / 8 + absError / 8;
+    }
+    state.delayMicros = (uint32_t)delay;
+    state.driftPpb = (int32_t)(newRate * 1e9);
+    state.samples++;
+    state.synced = state.samples >= SYNC_SYNCED_SAMPLES;
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::follow(uint32_t newMaster, int64_t now) {
+    // While only worse masters were heard the takeover timer keeps running,
+    // so the best lamp takes over after one timeout and not one per step
+    bool waiting = role == SYNC_LISTENING || (role == SYNC_FOLLOWER && master > id);
+    if (!waiting) {
+        listenStart = now;
+    }
+
+    master = newMaster;
+    role = SYNC_FOLLOWER;
+    requestPending = false;
+    delayIndex = 0;
+    delayCount = 0;
+    logEvent(LOG_SYNC_MASTER, SyncIdText(newMaster).text);
+
+    portENTER_CRITICAL(&syncLock);
+    state.role = role;
+    state.master = master;
+    state.samples = 0;
+    state.synced = false;
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::becomeMaster(int64_t now) {
+    master = id;
+    role = SYNC_MASTER;
+    nextSync = now;
+    requestPending = false;
+    logEvent(LOG_SYNC_MASTER, SyncIdText(id).text);
+
+    // The clock model stays as it is, the shared time continues from there
+    portENTER_CRITICAL(&syncLock);
+    state.role = role;
+    state.master = master;
+    state.synced = true;
+    state.errorMicros = 0;
+    state.jitterMicros = 0;
+    state.delayMicros = 0;
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::updatePeer(uint32_t peer, int32_t errorMicros, uint32_t delayMicros, int64_t now) {
+    portENTER_CRITICAL(&syncLock);
+    uint8_t i = 0;
+    while (i < state.peerCount && state.peers[i].id != peer) {
+        i++;
+    }
+    if (i == state.peerCount && state.peerCount < SYNC_MAX_PEERS) {
+        state.peerCount++;
+    }
+    if (i < state.peerCount) {
+        state.peers[i].id = peer;
+        state.peers[i].errorMicros = errorMicros;
+        state.peers[i].delayMicros = delayMicros;
+        peerSeen[i] = now;
+    }
+    portEXIT_CRITICAL(&syncLock);
+}
+
+void LampSync::startScene(int64_t now, uint32_t delayMillis) {
+    int64_t start = toShared(now) + (int64_t)delayMillis * 1000;
+
+    // Start time as number, unique enough to drop the repeats
+    sceneSender = id;
+    sceneNumber = (uint32_t)start;
+    sceneRepeat = SYNC_SCENE_REPEAT;
+    sceneEndRepeat = 0;
+
+    portENTER_CRITICAL(&syncLock);
+    sceneActive = true;
+    sceneStart = start;
+    portEXIT_CRITICAL(&syncLock);
+
+    logEvent(LOG_SYNC_SCENE, SyncIdText(id).text, delayMillis);
+}
+
+void LampSync::endScene(uint32_t sender) {
+    portENTER_CRITICAL(&syncLock);
+    sceneActive = false;
+    portEXIT_CRITICAL(&syncLock);
+
+    logEvent(LOG_SYNC_SCENE_END, SyncIdText(sender).text);
+}
+
+void LampSync::send(uint8_t type, uint32_t target, uint32_t number, int64_t time) {
+    SyncMessage message;
+    message.magic[0] = 'L';
+    message.magic[1] = 'S';
+    message.version = SYNC_VERSION;
+    message.type = type;
+    message.sender = id;
+    message.target = target;
+    message.number = number;
+    message.time = time;
+
+    portENTER_CRITICAL(&syncLock);
+    message.errorMicros = state.errorMicros;
+    message.delayMicros = state.delayMicros;
+    portEXIT_CRITICAL(&syncLock);
+
+    struct sockaddr_in destination;
+    memset(&destination, 0, sizeof(destination));
+    destination.sin_family = AF_INET;
+    destination.sin_port = htons(SYNC_PORT);
+    destination.sin_addr.s_addr = groupAddress;
+
+    sendto(sock, &message, sizeof(message), 0, (struct sockaddr*)&destination, sizeof(destination));
+}
@@ -0,0 +1,155 @@
+#ifndef LAMP_SYNC_H
+#define LAMP_SYNC_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Shared timebase of the lamps on the network, build with 0 to run every
+// lamp on its own clock
+#ifndef LAMP_SYNC
+#define LAMP_SYNC 1
+#endif
+
+#ifndef SYNC_GROUP
+#define SYNC_GROUP "239.255.76.83"  // Administratively scoped, stays in the LAN
+#endif
+
+#ifndef SYNC_PORT
+#define SYNC_PORT 4210
+#endif
+
+#define SYNC_INTERVAL_MS 1000   // Period of the master's SYNC messages
+#define SYNC_MASTER_TIMEOUT 3   // SYNC intervals without a master before taking over
+#define SYNC_STEP_MICROS 10000  // Larger errors step the clock instead of slewing it
+#define SYNC_DELAY_WINDOW 8     // Samples of the minimum delay filter
+#define SYNC_MAX_PEERS 8        // Followers listed by the master
+#define SYNC_SCENE_REPEAT 3     // Scene commands are sent this often, UDP may drop one
+#define SYNC_SCENE_DELAY 500    // Default ms from the command to the scene start
+
+enum SyncRole : uint8_t {
+    SYNC_OFF,
+    SYNC_LISTENING,  // Waiting for a master before becoming one
+    SYNC_FOLLOWER,
+    SYNC_MASTER
+};
+
+// Follower as seen by the master, from its delay requests
+struct SyncPeer {
+    uint32_t id;
+    int32_t errorMicros;
+    uint32_t delayMicros;
+};
+
+struct SyncState {
+    SyncRole role;
+    uint32_t id;
+    uint32_t master;
+    bool synced;
+    int32_t errorMicros;      // Residual of the last accepted sample
+    uint32_t jitterMicros;    // Average absolute residual
+    uint32_t delayMicros;     // One-way network delay of the last accepted sample
+    int32_t driftPpb;         // Rate of the shared clock against the local clock
+    uint32_t samples;         // Accepted since following the current master
+    uint32_t rejected;        // Dropped by the delay filter
+    uint8_t peerCount;
+    SyncPeer peers[SYNC_MAX_PEERS];
+};
+
+// Local clock in microseconds, esp_timer_get_time() on the lamp
+typedef int64_t (*SyncClock)();
+
+// PTP-like clock sync over UDP multicast, see docs/LAMP_SYNC.md.
+//
+// The lamp with the lowest id is master and sends its time once per
+// interval. Followers answer with a delay request, estimate offset and
+// network delay from the four timestamps and steer a clock model
+// (offset plus drift) towards the master. A follower that takes over as
+// master keeps its model, so the shared time continues without a jump.
+//
+// Messages are received by a task of its own, so receive times are taken
+// when the packet arrives and not when loop() gets to it.
+class LampSync {
+public:
+    LampSync();
+    ~LampSync();
+
+    // interfaceAddress in network byte order, 0 for the default interface
+    bool begin(uint32_t id, SyncClock clock, uint32_t interfaceAddress = 0);
+    void stop();
+    bool isRunning() const { return active; }
+
+    // Shared time at a local time, both in microseconds
+    int64_t toShared(int64_t localMicros) const;
+
+    // Milliseconds since the start of the current scene, false before the
+    // start or when no scene was started
+    bool getSceneMillis(int64_t localMicros, uint32_t& sceneMillis) const;
+    // Microseconds until the next frame of the current scene starts, every
+    // frameMillis in scene time, false when no scene was started
+    bool getSceneFrameWait(int64_t localMicros, uint32_t frameMillis, uint32_t& waitMicros) const;
+    bool isSceneRunning() const;
+
+    void getState(SyncState& state) const;
+
+private:
+    int sock;
+    volatile bool running;     // Requested by begin() and stop()
+    volatile bool active;      // The task runs, until it closed the socket
+    TaskHandle_t task;
+    SyncClock clock;
+    uint32_t id;
+    uint32_t groupAddress;
+
+    // Task only
+    SyncRole role;
+    uint32_t master;
+    int64_t listenStart;
+    int64_t lastMasterSync;
+    int64_t nextSync;
+    int64_t syncTime;          // t1: master time in the last SYNC
+    int64_t syncReceived;      // t2: local time it arrived
+    int64_t requestSent;       // t3: local time of our delay request
+    uint32_t sequence;
+    bool requestPending;
+    uint32_t delays[SYNC_DELAY_WINDOW];
+    uint8_t delayIndex;
+    uint8_t delayCount;
+    uint32_t sceneNumber;
+    uint32_t sceneSender;
+    uint8_t sceneRepeat;
+    uint8_t sceneEndRepeat;
+    int64_t peerSeen[SYNC_MAX_PEERS];
+
+    // Shared with the readers, under the sync lock
+    int64_t offset;            // Clock model: shared = local + offset + rate * (local - reference)
+    int64_t reference;
+    double rate;
+    bool sceneActive;
+    int64_t sceneStart;        // Shared time
+    SyncState state;
+
+    static void taskMain(void* parameter);
+    void run();
+    void handleMessage(const uint8_t* data, int length, int64_t now);
+    void update(int64_t now);
+    void addSample(int64_t local, int64_t measured, int64_t delay);
+    void follow(uint32_t newMaster, int64_t now);
+    void becomeMaster(int64_t now);
+    void updatePeer(uint32_t peer, int32_t errorMicros, uint32_t delayMicros, int64_t now);
+    void startScene(int64_t now, uint32_t delayMillis);
+    void endScene(uint32_t sender);
+    void send(uint8_t type, uint32_t target, uint32_t number, int64_t time);
+};
+
+// Starts a scene on all lamps delayMillis from now. Safe from any task,
+// the sync task sends the command.
+void requestScene(uint32_t delayMillis = SYNC_SCENE_DELAY);
+
+// Ends the current scene on all lamps, their effects go back to the local
+// clock. Safe from any task.
+void requestSceneEnd();
+
+const char* getSyncRoleName(SyncRole role);
+
+#endif
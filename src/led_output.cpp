@@ -0,0 +1,367 @@
+#include "led_output.h"
+#include "profiler.h"
+#include <driver/rmt.h>
+#include <soc/soc_caps.h>
+
+#define SK6812_BIT_NS 1250  // 800kHz
+#define SK6812_RESET_US 80
+
+// RMT ticks of 25ns, APB clock 80MHz / 2
+#define RMT_CLOCK_DIVIDER 2
+#define RMT_TICKS(ns) ((ns) / 25)
+#define RMT_ITEMS_PER_PIXEL (LED_BYTES_PER_PIXEL * 8)
+
+template <typename T_METHOD>
+class NeoLedStrip : public LedStrip {
+public:
+    NeoLedStrip(uint16_t count, uint8_t pin) : bus(count, pin) {}
+
+    bool begin() override {
+        bus.Begin();
+        return true;
+    }
+    uint8_t* pixels() override { return bus.Pixels(); }
+    bool canShow() const override { return bus.CanShow(); }
+    // The edit buffer is the framebuffer of RGBW frames, keep it equal to
+    // the sent frame
+    void show() override {
+        bus.Dirty();
+        bus.Show(true);
+    }
+    void show(const FrameBuffer& frame, uint16_t start, uint16_t count) override {
+        frame.expand(start, count, bus.Pixels());
+        show();
+    }
+
+private:
+    NeoPixelBus<NeoGrbwFeature, T_METHOD> bus;
+};
+
+// SK6812 bits as RMT items: high time, then low time
+static constexpr uint32_t rmtItem(uint32_t highTicks, uint32_t lowTicks) {
+    return highTicks | (1u << 15) | (lowTicks << 16);
+}
+
+static const uint32_t SK6812_ZERO = rmtItem(RMT_TICKS(400), RMT_TICKS(850));
+static const uint32_t SK6812_ONE = rmtItem(RMT_TICKS(800), RMT_TICKS(450));
+static const uint32_t SK6812_RESET_TICKS = RMT_TICKS(SK6812_RESET_US * 1000);
+
+// Sends a frame without a wire buffer. The RMT driver refills its channel
+// memory from an interrupt, half a block of 32 bits at a time, and the
+// translator expands the next LED from the frame for each refill.
+class RmtFrameStrip : public LedStrip {
+public:
+    RmtFrameStrip(uint8_t channel, uint8_t pin)
+        : channel((rmt_channel_t)channel), pin(pin), installed(false),
+          frame(nullptr), frameStart(0), frameCount(0) {}
+
+    ~RmtFrameStrip() {
+        if (installed) rmt_driver_uninstall(channel);
+    }
+
+    bool begin() override {
+        rmt_config_t config = RMT_DEFAULT_CONFIG_TX((gpio_num_t)pin, channel);
+        config.clk_div = RMT_CLOCK_DIVIDER;
+        if (rmt_config(&config) != ESP_OK || rmt_driver_install(channel, 0, 0) != ESP_OK) {
+            return false;
+        }
+        installed = true;
+        return rmt_translator_init(channel, translate) == ESP_OK &&
+               rmt_translator_set_context(channel, this) == ESP_OK;
+    }
+
+    uint8_t* pixels() override { return nullptr; }
+
+    bool canShow() const override {
+        return installed && rmt_wait_tx_done(channel, 0) == ESP_OK;
+    }
+
+    void show() override {}
+
+    void show(const FrameBuffer& frame, uint16_t start, uint16_t count) override {
+        if (!installed) return;
+
+        // The interrupt still reads the previous frame until it is out
+        rmt_wait_tx_done(channel, portMAX_DELAY);
+        this->frame = &frame;
+        frameStart = start;
+        frameCount = count;
+
+        // The driver only counts the source, one byte per LED. It never
+        // reads it, the translator reads the frame.
+        rmt_write_sample(channel, (const uint8_t*)&frame, count, false);
+    }
+
+private:
+    rmt_channel_t channel;
+    uint8_t pin;
+    bool installed;
+    const FrameBuffer* frame;
+    uint16_t frameStart;
+    uint16_t frameCount;
+
+    // Runs in the RMT interrupt. Not in IRAM, the driver is installed
+    // without ESP_INTR_FLAG_IRAM and defers it while flash is written.
+    static void translate(const void*, rmt_item32_t* dest, size_t srcSize,
+                          size_t wantedNum, size_t* translatedSize, size_t* itemNum) {
+        void* context = nullptr;
+        rmt_translator_get_context(itemNum, &context);
+        const RmtFrameStrip* strip = (const RmtFrameStrip*)context;
+
+        size_t pixels = 0;
+        size_t items = 0;
+        while (pixels < srcSize && items + RMT_ITEMS_PER_PIXEL <= wantedNum) {
+            // srcSize counts the LEDs still to send
+            uint16_t index = strip->frameStart + strip->frameCount - (srcSize - pixels);
+            uint8_t grbw[LED_BYTES_PER_PIXEL];
+            strip->frame->expand(index, 1, grbw);
+
+            for (uint8_t i = 0; i < LED_BYTES_PER_PIXEL; i++) {
+                for (uint8_t bit = 0x80; bit; bit >>= 1) {
+                    dest[items++].val = grbw[i] & bit ? SK6812_ONE : SK6812_ZERO;
+                }
+            }
+            pixels++;
+        }
+
+        // Stretch the low time of the last bit into the reset, so the next
+        // frame can start as soon as this one is done
+        if (pixels == srcSize && items > 0) {
+            dest[items - 1].duration1 = SK6812_RESET_TICKS;
+        }
+
+        *translatedSize = pixels;
+        *itemNum = items;
+    }
+};
+
+static LedStrip* createFrameStrip(uint8_t channel, uint8_t pin) {
+    if (channel >= SOC_RMT_TX_CANDIDATES_PER_GROUP) return nullptr;
+    return new RmtFrameStrip(channel, pin);
+}
+
+static LedStrip* createRmtStrip(uint8_t channel, uint16_t count, uint8_t pin) {
+    switch (channel) {
+        case 0: return new NeoLedStrip<NeoEsp32Rmt0Sk6812Method>(count, pin);
+        case 1: return new NeoLedStrip<NeoEsp32Rmt1Sk6812Method>(count, pin);
+#if SOC_RMT_TX_CANDIDATES_PER_GROUP > 2
+        case 2: return new NeoLedStrip<NeoEsp32Rmt2Sk6812Method>(count, pin);
+        case 3: return new NeoLedStrip<NeoEsp32Rmt3Sk6812Method>(count, pin);
+#endif
+#if SOC_RMT_TX_CANDIDATES_PER_GROUP > 4
+        case 4: return new NeoLedStrip<NeoEsp32Rmt4Sk6812Method>(count, pin);
+        case 5: return new NeoLedStrip<NeoEsp32Rmt5Sk6812Method>(count, pin);
+        case 6: return new NeoLedStrip<NeoEsp32Rmt6Sk6812Method>(count, pin);
+        case 7: return new NeoLedStrip<NeoEsp32Rmt7Sk6812Method>(count, pin);
+#endif
+        default: return nullptr;
+    }
+}
+
+static LedStrip* createI2sStrip(uint16_t count, uint8_t pin) {
+#if defined(CONFIG_IDF_TARGET_ESP32)
+    // All X8 buses share I2S1, data is sent once every bus called Show()
+    return new NeoLedStrip<NeoEsp32I2s1X8Sk6812Method>(count, pin);
+#else
+    return nullptr;
+#endif
+}
+
+LedOutput::LedOutput(uint16_t pixelCount, const uint8_t* pins, uint8_t outputCount,
+                     LedOutputMethod method, FrameBufferFormat format)
+    : pixelCount(pixelCount), method(method), format(format) {
+    if (outputCount < 1) outputCount = 1;
+    if (outputCount > LED_OUTPUT_MAX) outputCount = LED_OUTPUT_MAX;
+    if (outputCount > pixelCount) outputCount = pixelCount > 0 ? pixelCount : 1;
+    pixelsPerOutput = (pixelCount + outputCount - 1) / outputCount;
+    if (pixelsPerOutput < 1) pixelsPerOutput = 1;
+    // Drop outputs that would be left without LEDs by the rounded split
+    this->outputCount = (pixelCount + pixelsPerOutput - 1) / pixelsPerOutput;
+    if (this->outputCount < 1) this->outputCount = 1;
+
+    for (uint8_t i = 0; i < LED_OUTPUT_MAX; i++) {
+        this->pins[i] = i < this->outputCount ? pins[i] : 0;
+        strips[i] = nullptr;
+        wire[i] = nullptr;
+    }
+}
+
+LedOutput::~LedOutput() {
+    for (uint8_t i = 0; i < outputCount; i++) {
+        delete strips[i];
+    }
+}
+
+bool LedOutput::begin() {
+    // Compact frames on RMT are expanded while sending, no wire buffer
+    bool expandOnSend = method == LED_OUTPUT_RMT && format != FRAMEBUFFER_RGBW;
+
+    for (uint8_t i = 0; i < outputCount; i++) {
+        uint16_t length = getOutputLength(i);
+
+        if (method == LED_OUTPUT_I2S) {
+            strips[i] = createI2sStrip(length, pins[i]);
+        } else if (expandOnSend) {
+            strips[i] = createFrameStrip(i, pins[i]);
+        } else {
+            strips[i] = createRmtStrip(i, length, pins[i]);
+        }
+
+        if (!strips[i]) {
+            Serial.printf("LED output %d: no %s channel available\n", i,
+                          method == LED_OUTPUT_I2S ? "I2S" : "RMT");
+            return false;
+        }
+
+        if (!strips[i]->begin()) {
+            Serial.printf("LED output %d: failed to start\n", i);
+            return false;
+        }
+        Serial.printf("LED output %d: GPIO %d, %d LEDs%s\n", i, pins[i], length,
+                      expandOnSend ? ", expanded while sending" : "");
+    }
+
+    updateWireBuffers();
+    clear();
+    return true;
+}
+
+FrameBuffer* LedOutput::createFrameBuffer() {
+    if (format == FRAMEBUFFER_RGBW) {
+        return new WireFrameBuffer(*this);
+    }
+    return ::createFrameBuffer(format, pixelCount);
+}
+
+uint16_t LedOutput::getOutputLength(uint8_t output) const {
+    uint16_t start = output * pixelsPerOutput;
+    if (start >= pixelCount) return 0;
+    uint16_t remaining = pixelCount - start;
+    return remaining < pixelsPerOutput ? remaining : pixelsPerOutput;
+}
+
+// NeoPixelBus swaps edit and send buffer on every show
+void LedOutput::updateWireBuffers() {
+    for (uint8_t i = 0; i < outputCount; i++) {
+        wire[i] = strips[i] ? strips[i]->pixels() : nullptr;
+    }
+}
+
+uint8_t* LedOutput::pixelAddress(uint16_t index) const {
+    uint8_t output = index / pixelsPerOutput;
+    uint16_t offset = index - output * pixelsPerOutput;
+    if (!wire[output]) return nullptr;
+    return wire[output] + offset * LED_BYTES_PER_PIXEL;
+}
+
+uint16_t LedOutput::getRunLength(uint16_t index, uint16_t count) const {
+    uint16_t remaining = pixelsPerOutput - index % pixelsPerOutput;
+    if (remaining > pixelCount - index) remaining = pixelCount - index;
+    return count < remaining ? count : remaining;
+}
+
+void LedOutput::setPixelColor(uint16_t index, const RgbwColor& color) {
+    if (index >= pixelCount) return;
+
+    uint8_t* p = pixelAddress(index);
+    if (!p) return;
+    p[0] = color.G;
+    p[1] = color.R;
+    p[2] = color.B;
+    p[3] = color.W;
+}
+
+RgbwColor LedOutput::getPixelColor(uint16_t index) const {
+    if (index >= pixelCount) return RgbwColor(0);
+
+    const uint8_t* p = pixelAddress(index);
+    if (!p) return RgbwColor(0);
+    return RgbwColor(p[1], p[0], p[2], p[3]);
+}
+
+void LedOutput::clear(const RgbwColor& color) {
+    for (uint16_t i = 0; i < pixelCount; i++) {
+        setPixelColor(i, color);
+    }
+}
+
+bool LedOutput::canShow() const {
+    for (uint8_t i = 0; i < outputCount; i++) {
+        // A strip that failed to start never can
+        if (!strips[i] || !strips[i]->canShow()) return false;
+    }
+    return true;
+}
+
+void LedOutput::show() {
+    // RMT Show() returns right after starting the transfer, so issuing all
+    // outputs back to back lets them send in parallel
+    for (uint8_t i = 0; i < outputCount; i++) {
+        if (strips[i]) strips[i]->show();
+    }
+    updateWireBuffers();
+}
+
+void LedOutput::show(const FrameBuffer& frame) {
+    PROFILE_SCOPE(PROFILE_SHOW);
+
+    // Each output starts sending while the next one is being expanded
+    for (uint8_t i = 0; i < outputCount; i++) {
+        if (strips[i]) strips[i]->show(frame, i * pixelsPerOutput, getOutputLength(i));
+    }
+    updateWireBuffers();
+}
+
+unsigned long LedOutput::getFrameMicros() const {
+    unsigned long bits = (unsigned long)pixelsPerOutput * LED_BYTES_PER_PIXEL * 8;
+    return bits * SK6812_BIT_NS / 1000 + SK6812_RESET_US;
+}
+
+// WireFrameBuffer
+
+bool WireFrameBuffer::begin() {
+    // Nothing to allocate, the wire buffers exist once the output started
+    return leds.wire[0] != nullptr;
+}
+
+void WireFrameBuffer::setPixelColor(uint16_t index, const RgbwColor& color) {
+    leds.setPixelColor(index, color);
+}
+
+RgbwColor WireFrameBuffer::getPixelColor(uint16_t index) const {
+    return leds.getPixelColor(index);
+}
+
+// Ranges may span outputs, copy one output at a time
+void WireFrameBuffer::expand(uint16_t start, uint16_t count, uint8_t* wire) const {
+    if (start >= pixelCount) return;
+    if (count > pixelCount - start) count = pixelCount - start;
+
+    while (count > 0) {
+        uint16_t run = leds.getRunLength(start, count);
+        const uint8_t* pixels = leds.pixelAddress(start);
+        // show() passes the buffer the pixels already are in
+        if (pixels && pixels != wire) {
+            memcpy(wire, pixels, (size_t)run * LED_BYTES_PER_PIXEL);
+        }
+        start += run;
+        count -= run;
+        wire += run * LED_BYTES_PER_PIXEL;
+    }
+}
+
+void WireFrameBuffer::writePixels(uint16_t start, uint16_t count, const uint8_t* grbw) {
+    if (start >= pixelCount) return;
+    if (count > pixelCount - start) count = pixelCount - start;
+
+    while (count > 0) {
+        uint16_t run = leds.getRunLength(start, count);
+        uint8_t* pixels = leds.pixelAddress(start);
+        if (pixels) {
+            memcpy(pixels, grbw, (size_t)run * LED_BYTES_PER_PIXEL);
+        }
+        start += run;
+        count -= run;
+        grbw += run * LED_BYTES_PER_PIXEL;
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef LED_OUTPUT_H
+#define LED_OUTPUT_H
+
+#include <Arduino.h>
+#include <NeoPixelBus.h>
+#include "frame_buffer.h"
+
+// Total number of LEDs of the logical strip
+#ifndef LED_COUNT
+#define LED_COUNT 60
+#endif
+
+// Number of physical outputs the logical strip is split across
+#ifndef LED_OUTPUTS
+#define LED_OUTPUTS 1
+#endif
+
+// Data pin of each output, in logical strip order
+#ifndef LED_PINS
+#define LED_PINS { 5 }
+#endif
+
+// Output peripheral: LED_OUTPUT_RMT or LED_OUTPUT_I2S
+#ifndef LED_OUTPUT_METHOD
+#define LED_OUTPUT_METHOD LED_OUTPUT_RMT
+#endif
+
+#define LED_OUTPUT_MAX 8
+#define LED_BYTES_PER_PIXEL 4  // SK6812 GRBW wire format
+
+enum LedOutputMethod {
+    LED_OUTPUT_RMT,  // One RMT channel per output
+    LED_OUTPUT_I2S   // ESP32 I2S1 in 8-bit parallel mode
+};
+
+// One physical SK6812 strip
+class LedStrip {
+public:
+    virtual ~LedStrip() {}
+    virtual bool begin() = 0;
+    virtual uint8_t* pixels() = 0;  // GRBW wire buffer, nullptr if the strip has none
+    virtual bool canShow() const = 0;
+    // Start sending the wire buffer
+    virtual void show() = 0;
+    // Start sending pixels [start, start + count) of a frame
+    virtual void show(const FrameBuffer& frame, uint16_t start, uint16_t count) = 0;
+};
+
+// Logical LED strip split into consecutive ranges, one per output.
+// All outputs transmit at the same time, so the frame time is bound by
+// the longest output instead of the total LED count.
+//
+// The framebuffer format decides how frames reach the wire. RGBW frames
+// are the NeoPixelBus wire buffers themselves. Palette and RLE frames are
+// expanded by the RMT interrupt while they are sent, without any wire
+// buffer. The I2S method has no such hook, there compact frames are
+// expanded into the NeoPixelBus buffers.
+class LedOutput {
+public:
+    LedOutput(uint16_t pixelCount, const uint8_t* pins, uint8_t outputCount,
+              LedOutputMethod method = LED_OUTPUT_RMT,
+              FrameBufferFormat format = FRAMEBUFFER_RGBW);
+    ~LedOutput();
+
+    bool begin();
+    uint16_t getPixelCount() const { return pixelCount; }
+    uint8_t getOutputCount() const { return outputCount; }
+
+    // Framebuffer to render into, begin() it after the output
+    FrameBuffer* createFrameBuffer();
+
+    // Direct access to the wire buffers, not available for compact
+    // formats on RMT
+    void setPixelColor(uint16_t index, const RgbwColor& color);
+    RgbwColor getPixelColor(uint16_t index) const;
+    void clear(const RgbwColor& color = RgbwColor(0));
+
+    // True when every output finished sending the previous frame
+    bool canShow() const;
+    // Start transmission on all outputs, waits only for a frame still in flight
+    void show();
+    // Send a framebuffer. Palette and RLE frames on RMT are read while they
+    // are sent, only change them again once canShow() is true.
+    void show(const FrameBuffer& frame);
+
+    // Wire time of one frame in microseconds for the longest output
+    unsigned long getFrameMicros() const;
+
+private:
+    uint16_t pixelCount;
+    uint16_t pixelsPerOutput;
+    uint8_t outputCount;
+    uint8_t pins[LED_OUTPUT_MAX];
+    LedOutputMethod method;
+    FrameBufferFormat format;
+    LedStrip* strips[LED_OUTPUT_MAX];
+    uint8_t* wire[LED_OUTPUT_MAX];  // Edit buffer of each strip, moves on every show
+
+    uint16_t getOutputLength(uint8_t output) const;
+    uint8_t* pixelAddress(uint16_t index) const;
+    // Pixels from index to the end of its output, at most count
+    uint16_t getRunLength(uint16_t index, uint16_t count) const;
+    void updateWireBuffers();
+
+    friend class WireFrameBuffer;
+};
+
+// RGBW frame stored in the wire buffers of the outputs, so the frame
+// needs no memory of its own
+class WireFrameBuffer : public FrameBuffer {
+public:
+    explicit WireFrameBuffer(LedOutput& leds) : FrameBuffer(leds.getPixelCount()), leds(leds) {}
+
+    bool begin() override;
+    void setPixelColor(uint16_t index, const RgbwColor& color) override;
+    RgbwColor getPixelColor(uint16_t index) const override;
+    void expand(uint16_t start, uint16_t count, uint8_t* wire) const override;
+    void writePixels(uint16_t start, uint16_t count, const uint8_t* grbw) override;
+    size_t getMemoryUsage() const override { return 0; }
+    const char* getFormatName() const override { return "RGBW"; }
+
+private:
+    LedOutput& leds;
+};
+
+#endif
@@ -0,0 +1,246 @@
+#include "log_buffer.h"
+#include <stdarg.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+
+#define LOG_TASK_STACK 3072
+#define LOG_TASK_PRIORITY tskIDLE_PRIORITY  // Below everything else
+#define LOG_DRAIN_INTERVAL_MS 20
+#define LOG_LINE_SIZE 128
+
+static_assert((LOG_RING_SIZE & (LOG_RING_SIZE - 1)) == 0, "LOG_RING_SIZE must be a power of two");
+
+// Keep in sync with LogMessage in log_buffer.h
+static const char* const LOG_FORMATS[LOG_MESSAGE_COUNT] = {
+    "Captive portal request: {} {}",
+    "Scanning for WiFi networks...",
+    "Scan found {} networks in {} ms",
+    "Attempting to connect to: {}",
+    "Connecting to WiFi: {}",
+    "WiFi connected, IP {}, signal {} dBm",
+    "WiFi connection failed after {} ms",
+    "WiFi credentials saved",
+    "Effect program saved ({} bytes)",
+    "Failed to save effect program",
+    "Effect program removed",
+    "Client joined the portal AP ({} connected)",
+    "Portal page served {} ms after the client joined",
+    "DNS rate limit: {} queries dropped",
+    "Web server shed {} requests ({} open, {} bytes free heap)",
+    "Sync master is lamp {}",
+    "Sync master {} lost",
+    "Sync clock stepped by {} ms",
+    "Scene from lamp {} starts in {} ms",
+    "Scene ended by lamp {}",
+};
+
+// Bounded multi producer, single consumer ring. A slot is free for the
+// producer at position p when its sequence is p, and holds a committed
+// record for the consumer when its sequence is p + 1.
+static LogRecord ring[LOG_RING_SIZE];
+static uint32_t head = 0;     // Next position to reserve, shared by producers
+static uint32_t tail = 0;     // Next position to drain, log task only
+static uint32_t dropped = 0;
+static bool started = false;
+
+// Formatted lines, written by the log task only
+static char history[LOG_HISTORY_SIZE];
+static size_t historyEnd = 0;
+static bool historyWrapped = false;
+static SemaphoreHandle_t historyLock = nullptr;
+
+LogRecord* reserveLogRecord(LogMessage message) {
+    if (!__atomic_load_n(&started, __ATOMIC_ACQUIRE)) {
+        return nullptr;
+    }
+
+    uint32_t position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+    while (true) {
+        LogRecord* record = &ring[position & (LOG_RING_SIZE - 1)];
+        int32_t state = (int32_t)(__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) - position);
+
+        if (state == 0) {
+            // Free, claim it unless another producer was faster
+            if (__atomic_compare_exchange_n(&head, &position, position + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                record->millis = millis();
+                record->message = message;
+                record->argCount = 0;
+                record->stringArgs = 0;
+                record->textLength = 0;
+                return record;
+            }
+        } else if (state < 0) {
+            // Not drained yet, the ring is full
+            __atomic_fetch_add(&dropped, 1, __ATOMIC_RELAXED);
+            return nullptr;
+        } else {
+            position = __atomic_load_n(&head, __ATOMIC_RELAXED);
+        }
+    }
+}
+
+void commitLogRecord(LogRecord* record) {
+    __atomic_store_n(&record->sequence, record->sequence + 1, __ATOMIC_RELEASE);
+}
+
+void addLogArg(LogRecord* record, const char* value) {
+    if (record->argCount >= LOG_MAX_ARGS) {
+        return;
+    }
+
+    // Strings share the text buffer, the last one is truncated
+    uint8_t offset = record->textLength < LOG_TEXT_SIZE ? record->textLength : LOG_TEXT_SIZE - 1;
+    size_t length = value ? strnlen(value, LOG_TEXT_SIZE - 1 - offset) : 0;
+    memcpy(record->text + offset, value, length);
+    record->text[offset + length] = '\0';
+    record->textLength = offset + length + 1;
+
+    record->stringArgs |= 1 << record->argCount;
+    record->args[record->argCount++] = offset;
+}
+
+static size_t appendLine(char* line, size_t used, size_t size, const char* format, ...) {
+    if (used >= size - 1) {
+        return used;
+    }
+    va_list args;
+    va_start(args, format);
+    int written = vsnprintf(line + used, size - used, format, args);
+    va_end(args);
+    used += written > 0 ? written : 0;
+    return used < size - 1 ? used : size - 1;
+}
+
+static void formatRecord(const LogRecord& record, char* line, size_t size) {
+    size_t used = appendLine(line, 0, size, "[%lu.%03lu] ",
+                             (unsigned long)record.millis / 1000,
+                             (unsigned long)record.millis % 1000);
+
+    const char* format = record.message < LOG_MESSAGE_COUNT ? LOG_FORMATS[record.message] : "?";
+    uint8_t arg = 0;
+
+    for (const char* p = format; *p && used < size - 1; p++) {
+        if (p[0] == '{' && p[1] == '}') {
+            p++;
+            if (arg < record.argCount) {
+                if (record.stringArgs & (1 << arg)) {
+                    used = appendLine(line, used, size, "%s", record.text + record.args[arg]);
+                } else {
+                    used = appendLine(line, used, size, "%ld", (long)record.args[arg]);
+                }
+                arg++;
+            }
+            continue;
+        }
+        line[used++] = *p;
+    }
+    line[used] = '\0';
+}
+
+static bool drainRecord(char* line, size_t size) {
+    LogRecord* record = &ring[tail & (LOG_RING_SIZE - 1)];
+    if (__atomic_load_n(&record->sequence, __ATOMIC_ACQUIRE) != tail + 1) {
+        return false;
+    }
+
+    formatRecord(*record, line, size);
+
+    // Hand the slot back to the producers one lap later
+    __atomic_store_n(&record->sequence, tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+    tail++;
+    return true;
+}
+
+static void appendHistory(const char* line) {
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    for (const char* p = line; ; p++) {
+        history[historyEnd++] = *p ? *p : '\n';
+        if (historyEnd == LOG_HISTORY_SIZE) {
+            historyEnd = 0;
+            historyWrapped = true;
+        }
+        if (!*p) break;
+    }
+    xSemaphoreGive(historyLock);
+}
+
+static void output(const char* line) {
+    Serial.println(line);
+    appendHistory(line);
+}
+
+static void logTask(void*) {
+    char line[LOG_LINE_SIZE];
+    uint32_t reportedDrops = 0;
+
+    while (true) {
+        while (drainRecord(line, sizeof(line))) {
+            output(line);
+        }
+
+        uint32_t drops = __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+        if (drops != reportedDrops) {
+            unsigned long now = millis();
+            snprintf(line, sizeof(line), "[%lu.%03lu] Log overflow: %lu messages dropped (%lu total)",
+                     now / 1000, now % 1000,
+                     (unsigned long)(drops - reportedDrops), (unsigned long)drops);
+            output(line);
+            reportedDrops = drops;
+        }
+
+        vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+    }
+}
+
+bool beginLog() {
+    if (started) {
+        return true;
+    }
+
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        ring[i].sequence = i;
+    }
+
+    historyLock = xSemaphoreCreateMutex();
+    if (!historyLock) {
+        return false;
+    }
+
+    if (xTaskCreate(logTask, "log", LOG_TASK_STACK, nullptr, LOG_TASK_PRIORITY, nullptr) != pdPASS) {
+        Serial.println("Failed to start log task");
+        return false;
+    }
+
+    __atomic_store_n(&started, true, __ATOMIC_RELEASE);
+    return true;
+}
+
+String getLogHistory() {
+    String text;
+    if (!historyLock) {
+        return text;
+    }
+
+    text.reserve(LOG_HISTORY_SIZE + 48);
+
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+    if (historyWrapped) {
+        text.concat(history + historyEnd, LOG_HISTORY_SIZE - historyEnd);
+    }
+    text.concat(history, historyEnd);
+    xSemaphoreGive(historyLock);
+
+    // The oldest line was partly overwritten
+    if (historyWrapped) {
+        text.remove(0, text.indexOf('\n') + 1);
+    }
+
+    text += "Dropped: " + String(getLogDropped()) + "\n";
+    return text;
+}
+
+uint32_t getLogDropped() {
+    return __atomic_load_n(&dropped, __ATOMIC_RELAXED);
+}
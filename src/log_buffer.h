@@ -0,0 +1,99 @@
+#ifndef LOG_BUFFER_H
+#define LOG_BUFFER_H
+
+#include <Arduino.h>
+#include <type_traits>
+
+// Records in the ring, must be a power of two
+#ifndef LOG_RING_SIZE
+#define LOG_RING_SIZE 64
+#endif
+
+// Formatted text kept for GET /api/log
+#ifndef LOG_HISTORY_SIZE
+#define LOG_HISTORY_SIZE 2048
+#endif
+
+#define LOG_MAX_ARGS 4
+#define LOG_TEXT_SIZE 40  // String arguments of one record together, truncated
+
+// Log messages, the format strings are in log_buffer.cpp.
+// Each '{}' in a format is replaced by the next argument.
+enum LogMessage : uint8_t {
+    LOG_PORTAL_REQUEST,       // method, url
+    LOG_SCAN_START,
+    LOG_SCAN_DONE,            // networks, ms
+    LOG_CONNECT_REQUEST,      // ssid
+    LOG_WIFI_CONNECTING,      // ssid
+    LOG_WIFI_CONNECTED,       // ip, rssi
+    LOG_WIFI_FAILED,          // ms
+    LOG_CREDENTIALS_SAVED,
+    LOG_EFFECT_SAVED,         // bytes
+    LOG_EFFECT_SAVE_FAILED,
+    LOG_EFFECT_REMOVED,
+    LOG_AP_CLIENT_JOINED,     // stations
+    LOG_PORTAL_SERVED,        // ms since the client joined
+    LOG_DNS_LIMITED,          // queries
+    LOG_WEB_SHED,             // requests, connections, free heap
+    LOG_SYNC_MASTER,          // lamp id
+    LOG_SYNC_MASTER_LOST,     // lamp id
+    LOG_SYNC_STEP,            // ms
+    LOG_SYNC_SCENE,           // lamp id, ms until the start
+    LOG_SYNC_SCENE_END,       // lamp id
+    LOG_MESSAGE_COUNT
+};
+
+// Binary log record, formatted later by the log task
+struct LogRecord {
+    uint32_t sequence;     // Slot state, owned by the ring
+    uint32_t millis;
+    LogMessage message;
+    uint8_t argCount;
+    uint8_t stringArgs;    // Bit n set: argument n is an offset into text
+    uint8_t textLength;
+    int32_t args[LOG_MAX_ARGS];
+    char text[LOG_TEXT_SIZE];
+};
+
+// Start the low priority task draining the ring to serial and history.
+// Messages logged before are dropped.
+bool beginLog();
+
+// Reserve returns nullptr when the ring is full, the message is counted as dropped
+LogRecord* reserveLogRecord(LogMessage message);
+void commitLogRecord(LogRecord* record);
+void addLogArg(LogRecord* record, const char* value);
+
+inline void addLogArg(LogRecord* record, const String& value) {
+    addLogArg(record, value.c_str());
+}
+
+template <typename T>
+inline void addLogArg(LogRecord* record, T value) {
+    static_assert(std::is_integral<T>::value || std::is_enum<T>::value,
+                  "Log arguments must be integers or strings");
+    if (record->argCount < LOG_MAX_ARGS) {
+        record->args[record->argCount++] = (int32_t)value;
+    }
+}
+
+// Log a message with integer or string arguments. Lock-free, never blocks
+// and never allocates, so it is safe in web server and WiFi callbacks.
+//   logEvent(LOG_SCAN_DONE, count, elapsed);
+template <typename... T>
+void logEvent(LogMessage message, const T&... args) {
+    LogRecord* record = reserveLogRecord(message);
+    if (!record) {
+        return;
+    }
+    (addLogArg(record, args), ...);
+    commitLogRecord(record);
+}
+
+// Recent log lines as text, oldest first
+String getLogHistory();
+
+// Messages lost because the ring was full
+uint32_t getLogDropped();
+
+#endif
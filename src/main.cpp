@@ -1,10 +1,48 @@
 #include <Arduino.h>
 #include "wifi_provisioning.h"
+#include "log_buffer.h"
+#include "led_output.h"
+#include "effect_vm.h"
+#include "effect_store.h"
+#include "native_effects.h"
+#include "color_tables.h"
+#include "segment_renderer.h"
+#include "benchmarks.h"
+#include "device_state.h"
+#include "profiler.h"
+#include "lamp_sync.h"
+#include <esp_timer.h>
+
+// Render rate of the light effects
+#ifndef LED_FPS
+#define LED_FPS 50
+#endif
+
+static const uint8_t LED_OUTPUT_PINS[] = LED_PINS;
+static_assert(sizeof(LED_OUTPUT_PINS) >= LED_OUTPUTS, "LED_PINS needs one pin per output");
 
 WiFiProvisioning wifiProv;
+LedOutput leds(LED_COUNT, LED_OUTPUT_PINS, LED_OUTPUTS, LED_OUTPUT_METHOD, LED_FRAMEBUFFER);
+FrameBuffer* frame = leds.createFrameBuffer();
+bool ledsReady = false;  // Outputs and framebuffer started, nothing renders before
+
+AmbientWaveEffect ambientEffect;
+ScriptEffect scriptEffect;
+ColorTemperatureEffect temperatureEffect;
+SegmentRenderer renderer(LED_COUNT);
+
+#if LAMP_SYNC
+LampSync lampSync;
+#endif
 
 void printSystemInfo();
 void handleSerialCommands();
+void printSyncStatus();
+void loadStoredEffect();
+void handleTemperatureCommand(String args);
+void renderFrame();
+void updateLampSync();
+unsigned long loopDelayMillis();
 
 void setup() {
     Serial.begin(115200);
@@ -16,6 +54,35 @@ void setup() {
 
     printSystemInfo();
 
+    // Network callbacks log through the ring buffer, drained by a low priority task
+    beginLog();
+
+    // Setup LED outputs, all pixels off
+    Serial.println("Initializing LEDs...");
+    uint32_t heapBefore = ESP.getFreeHeap();
+    ledsReady = leds.begin();
+    if (ledsReady && !frame->begin()) {
+        Serial.println("Failed to allocate the framebuffer");
+        ledsReady = false;
+    }
+    if (ledsReady) {
+        leds.show(*frame);
+    } else {
+        Serial.println("LEDs stay off, effects are not rendered");
+    }
+    uint32_t ledMemory = heapBefore - ESP.getFreeHeap();
+    Serial.printf("Framebuffer: %s, %d bytes (%.2f bytes/LED)\n",
+                  frame->getFormatName(),
+                  frame->getMemoryUsage(),
+                  (float)frame->getMemoryUsage() / LED_COUNT);
+    Serial.printf("LED heap usage: %d bytes (%.2f bytes/LED)\n",
+                  ledMemory, (float)ledMemory / LED_COUNT);
+
+    // Base segment over the whole strip, add more segments for zones
+    renderer.begin();
+    renderer.addSegment(0, LED_COUNT, &ambientEffect);
+    loadStoredEffect();
+
     // Setup WiFi with provisioning
     Serial.println("Initializing WiFi...");
     wifiProv.begin();
@@ -24,33 +91,55 @@ void setup() {
 }
 
 void loop() {
-    // Handle WiFi provisioning
-    wifiProv.loop();
+    {
+        PROFILE_SCOPE(PROFILE_LOOP);
 
-    // Handle serial commands
-    handleSerialCommands();
+        // Handle WiFi provisioning
+        wifiProv.loop();
+        updateLampSync();
 
-    static unsigned long lastPrint = 0;
-    unsigned long currentMillis = millis();
+        // Handle serial commands
+        handleSerialCommands();
+
+        // Render light effect
+        if (takeEffectProgramChanged()) {
+            loadStoredEffect();
+        }
+        renderFrame();
 
-    // Print status every 10 seconds
-    if (currentMillis - lastPrint >= 10000) {
-        lastPrint = currentMillis;
+        static unsigned long lastPrint = 0;
+        unsigned long currentMillis = millis();
 
-        Serial.printf("Uptime: %lu seconds | Free Heap: %d bytes | WiFi: %s",
-                      currentMillis / 1000,
-                      ESP.getFreeHeap(),
-                      wifiProv.isConnected() ? "Connected" : "Disconnected");
+        // Print status every 10 seconds
+        if (currentMillis - lastPrint >= 10000) {
+            lastPrint = currentMillis;
 
-        if (wifiProv.isConnected()) {
-            Serial.printf(" | IP: %s | RSSI: %d dBm",
-                         wifiProv.getIP().c_str(),
-                         wifiProv.getRSSI());
+            Serial.printf("Uptime: %lu seconds | Free Heap: %d bytes | WiFi: %s",
+                          currentMillis / 1000,
+                          ESP.getFreeHeap(),
+                          wifiProv.isConnected() ? "Connected" : "Disconnected");
+
+            if (wifiProv.isConnected()) {
+                Serial.printf(" | IP: %s | RSSI: %d dBm",
+                             wifiProv.getIP().c_str(),
+                             wifiProv.getRSSI());
+            }
+            Serial.println();
         }
-        Serial.println();
     }
 
-    delay(10);
+    delay(loopDelayMillis());
+}
+
+// 10 ms, shorter when the next frame of a synced scene starts sooner
+unsigned long loopDelayMillis() {
+#if LAMP_SYNC
+    uint32_t waitMicros;
+    if (lampSync.getSceneFrameWait(esp_timer_get_time(), 1000 / LED_FPS, waitMicros) && waitMicros < 10000) {
+        return (waitMicros + 999) / 1000;
+    }
+#endif
+    return 10;
 }
 
 void printSystemInfo() {
@@ -59,6 +148,7 @@ void printSystemInfo() {
     Serial.printf("  Chip Revision: %d\n", ESP.getChipRevision());
     Serial.printf("  CPU Frequency: %d MHz\n", ESP.getCpuFreqMHz());
     Serial.printf("  Free Heap: %d bytes\n", ESP.getFreeHeap());
+    Serial.printf("  PSRAM: %d bytes\n", ESP.getPsramSize());
     Serial.printf("  Flash Size: %d bytes\n", ESP.getFlashChipSize());
     Serial.printf("  SDK Version: %s\n\n", ESP.getSdkVersion());
 }
@@ -80,10 +170,54 @@ void handleSerialCommands() {
                     Serial.println("\nResetting WiFi credentials...");
                     wifiProv.reset();
                     // Device will restart after reset
+                } else if (commandBuffer.startsWith("bench ") && !ledsReady) {
+                    Serial.println("\nLEDs failed to start, benchmarks need them");
+                } else if (commandBuffer == "bench leds") {
+                    benchmarkLeds(leds, *frame);
+                } else if (commandBuffer == "bench effect") {
+                    benchmarkEffect(leds, *frame);
+                } else if (commandBuffer == "bench segments") {
+                    benchmarkSegments(leds, *frame);
+                } else if (commandBuffer == "bench color") {
+                    benchmarkColor(leds, *frame);
+                } else if (commandBuffer.startsWith("temperature")) {
+                    handleTemperatureCommand(commandBuffer.substring(11));
+#if PROFILING
+                } else if (commandBuffer == "profile") {
+                    Serial.print("\n");
+                    Serial.print(getProfileReport());
+                } else if (commandBuffer == "profile reset") {
+                    resetProfile();
+                    Serial.println("\nProfile counters cleared");
+#endif
+#if LAMP_SYNC
+                } else if (commandBuffer == "sync") {
+                    printSyncStatus();
+                } else if (commandBuffer == "scene") {
+                    requestScene();
+                    Serial.printf("\nScene starts on all lamps in %d ms\n", SYNC_SCENE_DELAY);
+                } else if (commandBuffer == "scene stop") {
+                    requestSceneEnd();
+                    Serial.println("\nScene ends on all lamps");
+#endif
                 } else if (commandBuffer == "help") {
                     Serial.println("\nAvailable commands:");
-                    Serial.println("  reset wifi - Clear saved WiFi credentials and restart");
-                    Serial.println("  help       - Show this help message");
+                    Serial.println("  reset wifi     - Clear saved WiFi credentials and restart");
+                    Serial.println("  bench leds     - Measure LED frame rate");
+                    Serial.println("  bench effect   - Compare script and native effect render time");
+                    Serial.println("  bench segments - Compare segment render time on one and two cores");
+                    Serial.println("  bench color    - Compare float and table color conversion");
+                    Serial.println("  temperature <K> [%] - White light at a color temperature, 'off' to end");
+#if LAMP_SYNC
+                    Serial.println("  sync           - Show clock sync with the other lamps");
+                    Serial.println("  scene          - Start the effects of all lamps together");
+                    Serial.println("  scene stop     - End the scene on all lamps");
+#endif
+#if PROFILING
+                    Serial.println("  profile        - Show task CPU, stack and section timing");
+                    Serial.println("  profile reset  - Clear section timing");
+#endif
+                    Serial.println("  help           - Show this help message");
                 } else {
                     Serial.printf("\nUnknown command: %s\n", commandBuffer.c_str());
                     Serial.println("Type 'help' for available commands");
@@ -97,3 +231,149 @@ void handleSerialCommands() {
     }
 }
 
+void loadStoredEffect() {
+    uint8_t program[EFFECT_MAX_PROGRAM_SIZE];
+    size_t length = loadEffectProgram(program, sizeof(program));
+
+    if (length > 0 && scriptEffect.load(program, length)) {
+        Serial.printf("Effect script loaded (%d bytes)\n", length);
+        renderer.setEffect(0, &scriptEffect);
+        return;
+    }
+
+    if (length > 0) {
+        Serial.printf("Stored effect script rejected: %s\n", scriptEffect.getError().c_str());
+    }
+    scriptEffect.unload();
+    renderer.setEffect(0, &ambientEffect);
+}
+
+// "temperature <kelvin> [percent]" shows white light on the base segment,
+// "temperature off" goes back to the stored effect
+void handleTemperatureCommand(String args) {
+    args.trim();
+    if (args == "off") {
+        loadStoredEffect();
+        return;
+    }
+
+    int space = args.indexOf(' ');
+    long kelvin = (space < 0 ? args : args.substring(0, space)).toInt();
+    long percent = space < 0 ? 50 : args.substring(space + 1).toInt();
+    if (kelvin < KELVIN_MIN || kelvin > KELVIN_MAX || percent < 0 || percent > 100) {
+        Serial.printf("\nUsage: temperature <%d-%d> [0-100], or temperature off\n", KELVIN_MIN, KELVIN_MAX);
+        return;
+    }
+
+    temperatureEffect.setKelvin(kelvin);
+    temperatureEffect.setLevel(percent * 65535 / 100);
+    renderer.setEffect(0, &temperatureEffect);
+    Serial.printf("\nWhite light at %ldK, %ld%%\n", kelvin, percent);
+}
+
+// Whether a frame is due, and the effect time to render it at
+bool frameDue(unsigned long now, unsigned long& effectMillis) {
+    static unsigned long lastFrame = 0;
+
+#if LAMP_SYNC
+    // In a scene every lamp renders the frames of the shared clock, the
+    // same frame at the same moment
+    static uint32_t lastSceneFrame = UINT32_MAX;
+    uint32_t sceneMillis;
+    if (lampSync.getSceneMillis(esp_timer_get_time(), sceneMillis)) {
+        uint32_t sceneFrame = sceneMillis / (1000 / LED_FPS);
+        if (sceneFrame == lastSceneFrame || !leds.canShow()) {
+            return false;
+        }
+        lastSceneFrame = sceneFrame;
+        lastFrame = now;
+        effectMillis = sceneFrame * (1000 / LED_FPS);
+        return true;
+    }
+#endif
+
+    if (now - lastFrame < 1000 / LED_FPS || !leds.canShow()) {
+        return false;
+    }
+    lastFrame = now;
+    effectMillis = now;
+    return true;
+}
+
+void renderFrame() {
+    unsigned long effectMillis;
+    if (!ledsReady || !frameDue(millis(), effectMillis)) {
+        return;
+    }
+
+    // A failing script only disables itself
+    if (renderer.getSegment(0).effect == &scriptEffect && !scriptEffect.isLoaded()) {
+        renderer.setEffect(0, &ambientEffect);
+    }
+
+    renderer.render(*frame, effectMillis);
+    unsigned long showStart = micros();
+    leds.show(*frame);
+    unsigned long showMicros = micros() - showStart;
+
+    // Snapshot for /api/state
+    static uint32_t frames = 0;
+    const Segment& base = renderer.getSegment(0);
+    LightState state;
+    state.effect = base.effect ? base.effect->getName() : "none";
+    state.scriptLoaded = scriptEffect.isLoaded();
+    state.segments = renderer.getSegmentCount();
+    state.pixels = LED_COUNT;
+    state.fps = LED_FPS;
+    state.frames = ++frames;
+    state.renderMicros = renderer.getStats().frameMicros;
+    state.showMicros = showMicros;
+    publishLightState(state);
+}
+
+void updateLampSync() {
+#if LAMP_SYNC
+    static unsigned long lastAttempt = 0;
+    bool connected = wifiProv.isConnected();
+
+    // Sync runs while connected to the home network
+    if (connected && !lampSync.isRunning() && millis() - lastAttempt >= 5000) {
+        lastAttempt = millis();
+
+        // Modem sleep holds multicast back until the next beacon, 100 ms
+        // and more, the lamps are on mains power anyway
+        WiFi.setSleep(false);
+
+        // Lamp id from the device part of the MAC, the lowest becomes master
+        uint32_t id = (uint32_t)(ESP.getEfuseMac() >> 16);
+        if (lampSync.begin(id, esp_timer_get_time, (uint32_t)WiFi.localIP())) {
+            Serial.printf("Lamp sync started, id %08x\n", id);
+        } else {
+            Serial.println("Failed to start lamp sync");
+        }
+    } else if (!connected && lampSync.isRunning()) {
+        lampSync.stop();
+    }
+
+    SyncState state;
+    lampSync.getState(state);
+    publishSyncState(state);
+#endif
+}
+
+void printSyncStatus() {
+#if LAMP_SYNC
+    SyncState state;
+    lampSync.getState(state);
+
+    Serial.printf("\nLamp %08x: %s, master %08x, %s\n", state.id, getSyncRoleName(state.role),
+                  state.master, state.synced ? "synced" : "not synced");
+    Serial.printf("  Error: %d us, jitter %u us, delay %u us, drift %.3f ppm\n",
+                  state.errorMicros, state.jitterMicros, state.delayMicros, state.driftPpb / 1000.0f);
+    Serial.printf("  Samples: %u accepted, %u rejected\n", state.samples, state.rejected);
+    for (uint8_t i = 0; i < state.peerCount; i++) {
+        Serial.printf("  Follower %08x: error %d us, delay %u us\n",
+                      state.peers[i].id, state.peers[i].errorMicros, state.peers[i].delayMicros);
+    }
+#endif
+}
@@ -0,0 +1,31 @@
+#include "native_effects.h"
+#include "color_tables.h"
+#include <math.h>
+
+const uint8_t AMBIENT_WAVE_PROGRAM[] = {
+    0x46, 0x58, 0x01, 0x0a, 0x00, 0x00, 0x00, 0x30, 0x01, 0xcd, 0x0c, 0x00,
+    0x00, 0x12, 0x39, 0x00, 0x00, 0x33, 0x38, 0x00, 0x10, 0x28, 0x01, 0x00,
+    0x40, 0x00, 0x00, 0x12, 0x01, 0x9a, 0x59, 0x00, 0x00, 0x10, 0x39, 0x01,
+    0x38, 0x01, 0x38, 0x01, 0x01, 0x66, 0x66, 0x00, 0x00, 0x12, 0x01, 0x00,
+    0x00, 0x00, 0x00, 0x38, 0x01, 0x01, 0xcd, 0xcc, 0x00, 0x00, 0x12, 0x48,
+    0x00,
+};
+
+const size_t AMBIENT_WAVE_PROGRAM_SIZE = sizeof(AMBIENT_WAVE_PROGRAM);
+
+void AmbientWaveEffect::render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) {
+    float phase = (ms % 32768000UL) / 1000.0f * 0.05f;
+
+    for (uint16_t i = 0; i < count; i++) {
+        float pos = (float)i / count;
+        float brightness = 0.35f + 0.25f * sinf(2.0f * (float)M_PI * (pos + phase));
+        frame.setPixelColor(start + i, RgbwColor(brightness * 255.0f + 0.5f,
+                                                 brightness * 0.4f * 255.0f + 0.5f,
+                                                 0,
+                                                 brightness * 0.8f * 255.0f + 0.5f));
+    }
+}
+
+void ColorTemperatureEffect::render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long) {
+    frame.fill(start, count, LedColor::kelvinToRgbw(kelvin, level));
+}
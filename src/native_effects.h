@@ -0,0 +1,39 @@
+#ifndef NATIVE_EFFECTS_H
+#define NATIVE_EFFECTS_H
+
+#include <Arduino.h>
+#include "effect.h"
+
+// Slow warm brightness wave for evening ambient light.
+// Same effect as tools/effects/ambient_wave.fxa, used as reference for
+// the interpreter benchmark.
+class AmbientWaveEffect : public Effect {
+public:
+    const char* getName() const override { return "ambient"; }
+    void render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) override;
+};
+
+// Uniform white at a color temperature, e.g. warm evening light
+class ColorTemperatureEffect : public Effect {
+public:
+    ColorTemperatureEffect(uint16_t kelvin = 2700, uint16_t level = 32768)
+        : kelvin(kelvin), level(level) {}
+
+    const char* getName() const override { return "temperature"; }
+    void render(FrameBuffer& frame, uint16_t start, uint16_t count, unsigned long ms) override;
+
+    void setKelvin(uint16_t value) { kelvin = value; }
+    // Linear light level, 65535 = full brightness
+    void setLevel(uint16_t value) { level = value; }
+
+private:
+    uint16_t kelvin;
+    uint16_t level;
+};
+
+// tools/effects/ambient_wave.fxa assembled with tools/effect_asm.py --c-array,
+// the script side of the interpreter benchmarks
+extern const uint8_t AMBIENT_WAVE_PROGRAM[];
+extern const size_t AMBIENT_WAVE_PROGRAM_SIZE;
+
+#endif
@@ -7,7 +7,7 @@
 // WiFi Configuration Portal HTML - Built using MaterialPage helper class
 // Demonstrates reusable Material Design framework with automatic dark mode
 String getPortalHTML() {
-    String html = MaterialPage::getHeader("WiFi Setup - Smart Light");
+    String html = MaterialPage::getInlineHeader("WiFi Setup - Smart Light");
 
     // App bar
     html += MaterialPage::getAppBar("Smart Home Light", "WiFi Configuration");
@@ -0,0 +1,165 @@
+#include "profiler.h"
+
+#if PROFILING
+
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+static const char* const SECTION_NAMES[PROFILE_SECTION_COUNT] = {
+    "loop",
+    "captive dns",
+    "render",
+    "led show",
+    "http page",
+    "http state",
+    "http scan",
+    "http effect",
+};
+
+struct SectionStats {
+    uint32_t count;
+    uint32_t min;
+    uint32_t max;
+    uint64_t total;
+};
+
+// Run time counter of a task at the previous report
+struct TaskSample {
+    TaskHandle_t handle;
+    uint32_t runTime;
+};
+
+static portMUX_TYPE statsLock = portMUX_INITIALIZER_UNLOCKED;
+static SectionStats sections[PROFILE_SECTION_COUNT];
+
+// Report state, one report at a time
+static bool reporting = false;
+static TaskSample previous[PROFILE_MAX_TASKS];
+static uint8_t previousCount = 0;
+static uint32_t previousTotal = 0;
+static unsigned long previousMillis = 0;
+static unsigned long resetMillis = 0;
+
+void recordProfile(ProfileSection section, uint32_t cycles) {
+    portENTER_CRITICAL(&statsLock);
+    SectionStats& stats = sections[section];
+    if (stats.count == 0 || cycles < stats.min) stats.min = cycles;
+    if (cycles > stats.max) stats.max = cycles;
+    stats.total += cycles;
+    stats.count++;
+    portEXIT_CRITICAL(&statsLock);
+}
+
+void resetProfile() {
+    portENTER_CRITICAL(&statsLock);
+    memset(sections, 0, sizeof(sections));
+    portEXIT_CRITICAL(&statsLock);
+    resetMillis = millis();
+}
+
+static void appendTasks(String& report) {
+#if configUSE_TRACE_FACILITY
+    static TaskStatus_t tasks[PROFILE_MAX_TASKS];
+    uint32_t total = 0;
+    UBaseType_t count = uxTaskGetSystemState(tasks, PROFILE_MAX_TASKS, &total);
+    if (count == 0) {
+        report += "More tasks than PROFILE_MAX_TASKS\n";
+        return;
+    }
+
+    unsigned long now = millis();
+    char line[80];
+    snprintf(line, sizeof(line), "Tasks, CPU %% of one core over the last %lu ms\n",
+             now - previousMillis);
+    report += line;
+    report += "Task             Core   CPU %  Stack free B\n";
+
+    // Run time is counted by esp_timer in us and wraps after 71 minutes,
+    // differences stay right as long as reports are closer than that
+    uint32_t elapsed = total - previousTotal;
+    for (UBaseType_t i = 0; i < count; i++) {
+        const TaskStatus_t& task = tasks[i];
+
+        char core[4] = "-";
+#if configTASKLIST_INCLUDE_COREID
+        if (task.xCoreID != tskNO_AFFINITY) {
+            snprintf(core, sizeof(core), "%d", (int)task.xCoreID);
+        }
+#endif
+
+        char cpu[8] = "n/a";
+#if configGENERATE_RUN_TIME_STATS
+        uint32_t runTime = task.ulRunTimeCounter;
+        for (uint8_t p = 0; p < previousCount; p++) {
+            if (previous[p].handle == task.xHandle) {
+                runTime -= previous[p].runTime;
+                break;
+            }
+        }
+        if (elapsed > 0) {
+            snprintf(cpu, sizeof(cpu), "%.1f", runTime * 100.0f / elapsed);
+        }
+#endif
+
+        snprintf(line, sizeof(line), "%-16s %4s %7s %13u\n",
+                 task.pcTaskName, core, cpu, (unsigned)task.usStackHighWaterMark);
+        report += line;
+    }
+
+#if configGENERATE_RUN_TIME_STATS
+    for (UBaseType_t i = 0; i < count; i++) {
+        previous[i].handle = tasks[i].xHandle;
+        previous[i].runTime = tasks[i].ulRunTimeCounter;
+    }
+    previousCount = count;
+    previousTotal = total;
+#else
+    (void)elapsed;
+    report += "CPU % needs CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS\n";
+#endif
+    previousMillis = now;
+#else
+    report += "Task list needs CONFIG_FREERTOS_USE_TRACE_FACILITY\n";
+#endif
+}
+
+static void appendSections(String& report) {
+    SectionStats copy[PROFILE_SECTION_COUNT];
+    portENTER_CRITICAL(&statsLock);
+    memcpy(copy, sections, sizeof(copy));
+    portEXIT_CRITICAL(&statsLock);
+
+    uint32_t mhz = ESP.getCpuFreqMHz();
+    char line[96];
+    snprintf(line, sizeof(line), "\nSections, cycles at %u MHz over the last %lu ms\n",
+             (unsigned)mhz, millis() - resetMillis);
+    report += line;
+    report += "Section          Count      Min      Avg      Max   Avg us   Max us\n";
+
+    for (uint8_t i = 0; i < PROFILE_SECTION_COUNT; i++) {
+        const SectionStats& stats = copy[i];
+        uint32_t avg = stats.count ? stats.total / stats.count : 0;
+        snprintf(line, sizeof(line), "%-14s %7u %8u %8u %8u %8u %8u\n",
+                 SECTION_NAMES[i], (unsigned)stats.count, (unsigned)stats.min,
+                 (unsigned)avg, (unsigned)stats.max,
+                 (unsigned)(avg / mhz), (unsigned)(stats.max / mhz));
+        report += line;
+    }
+}
+
+String getProfileReport() {
+    // Serial and HTTP may ask at the same time, the task buffers are shared
+    if (__atomic_test_and_set(&reporting, __ATOMIC_ACQUIRE)) {
+        return "Profile report in progress, try again\n";
+    }
+
+    String report;
+    report.reserve(2048);
+    appendTasks(report);
+    appendSections(report);
+
+    __atomic_clear(&reporting, __ATOMIC_RELEASE);
+    return report;
+}
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <Arduino.h>
+
+// Profiling mode, build with 1 to see where CPU time goes. With 0 the
+// timers, the serial commands and /api/profile are compiled out.
+#ifndef PROFILING
+#define PROFILING 0
+#endif
+
+#define PROFILE_MAX_TASKS 24  // Tasks listed in the report
+
+// Measured sections, the names are in profiler.cpp
+enum ProfileSection : uint8_t {
+    PROFILE_LOOP,           // loop() body without the delay
+    PROFILE_DNS,            // Captive DNS polling in WiFiProvisioning::loop()
+    PROFILE_RENDER,         // SegmentRenderer::render()
+    PROFILE_SHOW,           // Expanding the frame and starting the LED transfer
+    PROFILE_HTTP_PAGE,      // GET / of the portal and the home server
+    PROFILE_HTTP_STATE,     // GET /api/state
+    PROFILE_HTTP_SCAN,      // GET /scan, includes the blocking WiFi scan
+    PROFILE_HTTP_EFFECT,    // POST /api/effect, verify and store
+    PROFILE_SECTION_COUNT
+};
+
+#if PROFILING
+
+// Adds one measurement, callable from any task
+void recordProfile(ProfileSection section, uint32_t cycles);
+
+// Task table (CPU % since the previous report, stack high-water marks) and
+// section table (min/avg/max cycles since the last reset) as text
+String getProfileReport();
+void resetProfile();
+
+// Measures the enclosing scope with the CPU cycle counter
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileSection section)
+        : section(section), core(xPortGetCoreID()), start(ESP.getCycleCount()) {}
+
+    ~ProfileScope() {
+        // The cycle counters of the two cores are not in sync,
+        // a task that moved to the other core gives no sample
+        if (xPortGetCoreID() == core) {
+            recordProfile(section, ESP.getCycleCount() - start);
+        }
+    }
+
+private:
+    ProfileSection section;
+    uint8_t core;
+    uint32_t start;
+};
+
+#define PROFILE_CONCAT_(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_(a, b)
+#define PROFILE_SCOPE(section) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(section)
+
+#else
+
+#define PROFILE_SCOPE(section) do {} while (0)
+
+#endif
+
+#endif
@@ -0,0 +1,204 @@
+#include "segment_renderer.h"
+#include "profiler.h"
+
+#define SEGMENT_WORKER_STACK 4096
+#define SEGMENT_WORKER_PRIORITY 1  // Same as the Arduino loop task, below WiFi
+#define SEGMENT_COMPOSE_CHUNK 32   // Pixels blended per frame buffer call
+
+SegmentRenderer::SegmentRenderer(uint16_t pixelCount)
+    : pixelCount(pixelCount), segmentCount(0), parallel(true),
+      worker(nullptr), workerDone(nullptr), nextSegment(0), target(nullptr), renderMillis(0) {
+    memset(&stats, 0, sizeof(stats));
+}
+
+SegmentRenderer::~SegmentRenderer() {
+    if (worker) vTaskDelete(worker);
+    if (workerDone) vSemaphoreDelete(workerDone);
+    clearSegments();
+}
+
+bool SegmentRenderer::begin() {
+#if portNUM_PROCESSORS > 1
+    workerDone = xSemaphoreCreateBinary();
+    if (!workerDone) return false;
+
+    // Pin the worker to the core the caller is not running on
+    BaseType_t core = xPortGetCoreID() == 0 ? 1 : 0;
+    if (xTaskCreatePinnedToCore(workerTask, "segments", SEGMENT_WORKER_STACK, this,
+                                SEGMENT_WORKER_PRIORITY, &worker, core) != pdPASS) {
+        Serial.println("Failed to start segment worker");
+        worker = nullptr;
+        return false;
+    }
+    Serial.printf("Segment worker started on core %d\n", core);
+#endif
+    return true;
+}
+
+int SegmentRenderer::addSegment(uint16_t start, uint16_t length, Effect* effect,
+                                BlendMode blend, uint8_t opacity) {
+    if (segmentCount >= SEGMENT_MAX || start >= pixelCount || length == 0) {
+        return -1;
+    }
+    if (length > pixelCount - start) {
+        length = pixelCount - start;
+    }
+
+    // A replace segment can render into the frame unless it has to cover an
+    // earlier segment, that one may still be rendering on the other core
+    bool direct = blend == BLEND_REPLACE;
+    for (uint8_t i = 0; i < segmentCount && direct; i++) {
+        const Segment& other = segments[i];
+        direct = start >= other.start + other.length || start + length <= other.start;
+    }
+
+    RgbwFrameBuffer* buffer = nullptr;
+    if (!direct) {
+        buffer = new RgbwFrameBuffer(length);
+        if (!buffer->begin()) {
+            delete buffer;
+            return -1;
+        }
+    }
+
+    Segment& segment = segments[segmentCount];
+    segment.start = start;
+    segment.length = length;
+    segment.effect = effect;
+    segment.blend = blend;
+    segment.opacity = opacity;
+    segment.buffer = buffer;
+    return segmentCount++;
+}
+
+void SegmentRenderer::setEffect(uint8_t index, Effect* effect) {
+    if (index < segmentCount) {
+        segments[index].effect = effect;
+    }
+}
+
+void SegmentRenderer::clearSegments() {
+    for (uint8_t i = 0; i < segmentCount; i++) {
+        delete segments[i].buffer;
+    }
+    segmentCount = 0;
+}
+
+void SegmentRenderer::workerTask(void* parameter) {
+    SegmentRenderer* renderer = (SegmentRenderer*)parameter;
+
+    while (true) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+        renderer->renderSegments(xPortGetCoreID());
+        xSemaphoreGive(renderer->workerDone);
+    }
+}
+
+// Both cores take segments from the shared index until none are left,
+// so a long segment on one core is balanced by several short ones on the other
+void SegmentRenderer::renderSegments(uint8_t core) {
+    unsigned long start = micros();
+
+    while (true) {
+        uint8_t index = __atomic_fetch_add(&nextSegment, 1, __ATOMIC_RELAXED);
+        if (index >= segmentCount) break;
+
+        Segment& segment = segments[index];
+        if (!segment.effect) continue;
+        if (segment.buffer) {
+            segment.effect->render(*segment.buffer, 0, segment.length, renderMillis);
+        } else {
+            segment.effect->render(*target, segment.start, segment.length, renderMillis);
+        }
+    }
+
+    stats.coreMicros[core] = micros() - start;
+}
+
+// Blends count bytes of GRBW pixels, channel order does not matter
+static void blendPixels(BlendMode blend, uint8_t* below, const uint8_t* above,
+                        size_t count, uint8_t opacity) {
+    switch (blend) {
+        case BLEND_ADD:
+            for (size_t i = 0; i < count; i++) {
+                uint16_t sum = below[i] + above[i];
+                below[i] = sum > 255 ? 255 : sum;
+            }
+            break;
+        case BLEND_MAX:
+            for (size_t i = 0; i < count; i++) {
+                if (above[i] > below[i]) below[i] = above[i];
+            }
+            break;
+        case BLEND_ALPHA:
+            for (size_t i = 0; i < count; i++) {
+                below[i] = (below[i] * (255 - opacity) + above[i] * opacity + 127) / 255;
+            }
+            break;
+        case BLEND_REPLACE:
+        default:
+            memcpy(below, above, count);
+            break;
+    }
+}
+
+// Only segments with a private buffer are left to compose
+void SegmentRenderer::compose(FrameBuffer& frame) {
+    uint8_t below[SEGMENT_COMPOSE_CHUNK * 4];
+
+    for (uint8_t s = 0; s < segmentCount; s++) {
+        const Segment& segment = segments[s];
+        if (!segment.buffer) continue;
+
+        const uint8_t* above = segment.buffer->getPixels();
+        for (uint16_t offset = 0; offset < segment.length; offset += SEGMENT_COMPOSE_CHUNK) {
+            uint16_t count = segment.length - offset;
+            if (count > SEGMENT_COMPOSE_CHUNK) count = SEGMENT_COMPOSE_CHUNK;
+            uint16_t index = segment.start + offset;
+
+            if (segment.blend == BLEND_REPLACE) {
+                frame.writePixels(index, count, above + offset * 4);
+                continue;
+            }
+            frame.expand(index, count, below);
+            blendPixels(segment.blend, below, above + offset * 4, count * 4, segment.opacity);
+            frame.writePixels(index, count, below);
+        }
+    }
+}
+
+void SegmentRenderer::render(FrameBuffer& frame, unsigned long ms) {
+    PROFILE_SCOPE(PROFILE_RENDER);
+    unsigned long start = micros();
+    target = &frame;
+    renderMillis = ms;
+    nextSegment = 0;
+    stats.coreMicros[0] = 0;
+    stats.coreMicros[1] = 0;
+
+    // Pixels no segment renders must be black, clear before any segment
+    // renders into the frame
+    bool covered = segmentCount > 0 && !segments[0].buffer &&
+                   segments[0].start == 0 && segments[0].length == pixelCount;
+    if (!covered) {
+        frame.clear();
+    }
+
+    // Only worth waking the worker when there is something to split
+    bool useWorker = worker && parallel && segmentCount > 1 && frame.supportsParallelWrites();
+    if (useWorker) {
+        xTaskNotifyGive(worker);
+    }
+
+    renderSegments(xPortGetCoreID());
+
+    // Barrier: the worker must be done before its buffers are composed
+    if (useWorker) {
+        xSemaphoreTake(workerDone, portMAX_DELAY);
+    }
+
+    unsigned long composeStart = micros();
+    compose(frame);
+    stats.composeMicros = micros() - composeStart;
+    stats.frameMicros = micros() - start;
+}
@@ -0,0 +1,83 @@
+#ifndef SEGMENT_RENDERER_H
+#define SEGMENT_RENDERER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/semphr.h>
+#include <freertos/task.h>
+#include "effect.h"
+#include "frame_buffer.h"
+
+#define SEGMENT_MAX 8
+
+enum BlendMode {
+    BLEND_REPLACE,  // Segment pixels replace the pixels below
+    BLEND_ADD,      // Saturating add, e.g. a reading spot on an ambient base
+    BLEND_MAX,      // Per channel maximum
+    BLEND_ALPHA     // Mix with the pixels below by segment opacity
+};
+
+struct Segment {
+    uint16_t start;
+    uint16_t length;
+    Effect* effect;
+    BlendMode blend;
+    uint8_t opacity;        // Used by BLEND_ALPHA, 255 = opaque
+    RgbwFrameBuffer* buffer;  // Private render target, nullptr when rendered into the frame
+};
+
+struct RenderStats {
+    unsigned long coreMicros[2];  // Time spent rendering segments per core
+    unsigned long composeMicros;  // Blending segments into the frame
+    unsigned long frameMicros;    // Whole render() call
+};
+
+// Renders a map of strip segments, each with its own effect and blend mode.
+// Segments are split between the calling task and a worker task on the
+// other core. Replace segments that no earlier segment overlaps render
+// straight into their slice of the frame. All others render into a private
+// RGBW buffer and are blended into the frame in map order after both cores
+// are done (barrier).
+//
+// An effect instance must only be used by one segment, segments may render
+// at the same time on different cores.
+class SegmentRenderer {
+public:
+    SegmentRenderer(uint16_t pixelCount);
+    ~SegmentRenderer();
+
+    bool begin();
+
+    // Returns the segment index or -1 when the map is full or out of memory
+    int addSegment(uint16_t start, uint16_t length, Effect* effect,
+                   BlendMode blend = BLEND_REPLACE, uint8_t opacity = 255);
+    void setEffect(uint8_t index, Effect* effect);
+    void clearSegments();
+    uint8_t getSegmentCount() const { return segmentCount; }
+    const Segment& getSegment(uint8_t index) const { return segments[index]; }
+
+    // Render on one core only, for comparison
+    void setParallel(bool enabled) { parallel = enabled; }
+
+    void render(FrameBuffer& frame, unsigned long ms);
+    const RenderStats& getStats() const { return stats; }
+
+private:
+    uint16_t pixelCount;
+    Segment segments[SEGMENT_MAX];
+    uint8_t segmentCount;
+    bool parallel;
+
+    TaskHandle_t worker;
+    SemaphoreHandle_t workerDone;
+    uint8_t nextSegment;  // Shared work index, taken atomically
+    FrameBuffer* target;  // Frame of the current render() call
+    unsigned long renderMillis;
+    RenderStats stats;
+
+    void renderSegments(uint8_t core);
+    void compose(FrameBuffer& frame);
+    static void workerTask(void* parameter);
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "web_admission.h"
+#include "log_buffer.h"
+
+#define SHED_LOG_INTERVAL_MS 1000
+
+// Only one server runs at a time, and AsyncTCP calls all of its callbacks
+// from one task, so the counters need no locking
+static AdmissionStats stats = { 0, 0, 0, 0, 0 };
+
+// One log line per second at most, a flood would fill the log ring
+static void logShed() {
+    static unsigned long lastLog = 0;
+    static uint32_t lastRejected = 0;
+
+    unsigned long now = millis();
+    uint32_t rejected = stats.rejectedBusy + stats.rejectedHeap;
+    if (lastLog == 0 || now - lastLog >= SHED_LOG_INTERVAL_MS) {
+        logEvent(LOG_WEB_SHED, rejected - lastRejected, stats.connections, ESP.getFreeHeap());
+        lastLog = now;
+        lastRejected = rejected;
+    }
+}
+
+bool AdmissionHandler::canHandle(AsyncWebServerRequest *request) {
+    bool lowHeap = ESP.getFreeHeap() < WEB_MIN_FREE_HEAP;
+    bool busy = stats.connections >= WEB_MAX_CONNECTIONS || stats.responses >= WEB_MAX_RESPONSES;
+    bool admit = !lowHeap && !busy;
+
+    stats.connections++;
+    if (admit) {
+        stats.responses++;
+        stats.admitted++;
+    } else if (lowHeap) {
+        stats.rejectedHeap++;
+    } else {
+        stats.rejectedBusy++;
+    }
+
+    request->onDisconnect([admit]() {
+        stats.connections--;
+        if (admit) {
+            stats.responses--;
+        }
+    });
+
+    if (admit) {
+        return false;  // Let the routes handle it
+    }
+
+    logShed();
+    return true;
+}
+
+void AdmissionHandler::handleRequest(AsyncWebServerRequest *request) {
+    static const char BODY[] = "Busy, retry later\n";
+
+    AsyncWebServerResponse *response = request->beginResponse_P(503, "text/plain",
+        (const uint8_t*)BODY, sizeof(BODY) - 1);
+    response->addHeader("Retry-After", String(WEB_RETRY_AFTER_SECONDS));
+    request->send(response);
+}
+
+void addAdmissionControl(AsyncWebServer* server) {
+    // Handlers are asked in the order they were added, this one goes first
+    server->addHandler(new AdmissionHandler());
+}
+
+const AdmissionStats& getAdmissionStats() {
+    return stats;
+}
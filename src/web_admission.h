@@ -0,0 +1,50 @@
+#ifndef WEB_ADMISSION_H
+#define WEB_ADMISSION_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+// Open requests at the same time, including rejected ones still being answered
+#ifndef WEB_MAX_CONNECTIONS
+#define WEB_MAX_CONNECTIONS 8
+#endif
+
+// Admitted requests building or sending a response at the same time
+#ifndef WEB_MAX_RESPONSES
+#define WEB_MAX_RESPONSES 4
+#endif
+
+// Free heap below which every request is rejected
+#ifndef WEB_MIN_FREE_HEAP
+#define WEB_MIN_FREE_HEAP 24576
+#endif
+
+#define WEB_RETRY_AFTER_SECONDS 2
+
+struct AdmissionStats {
+    uint16_t connections;   // Open requests
+    uint16_t responses;     // Admitted requests in flight
+    uint32_t admitted;
+    uint32_t rejectedBusy;  // Over a concurrency limit
+    uint32_t rejectedHeap;  // Below the heap watermark
+};
+
+// First handler of a web server. Admits a request to the routes behind it,
+// or answers it with 503 and Retry-After, so a burst of clients cannot
+// exhaust the heap.
+//
+// Counts are released in the request's onDisconnect callback, routes must
+// not set their own.
+class AdmissionHandler : public AsyncWebHandler {
+public:
+    bool canHandle(AsyncWebServerRequest *request) override;
+    void handleRequest(AsyncWebServerRequest *request) override;
+    bool isRequestHandlerTrivial() override { return true; }
+};
+
+// Add admission control, call before registering any route
+void addAdmissionControl(AsyncWebServer* server);
+
+const AdmissionStats& getAdmissionStats();
+
+#endif
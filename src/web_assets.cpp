@@ -0,0 +1,37 @@
+#include "web_assets.h"
+#include "web_material.h"
+
+// Strong ETag of the stylesheet, "<hash>" including the quotes
+static String getMaterialETag() {
+    return "\"" + String(MATERIAL_CSS_HASH, HEX) + "\"";
+}
+
+// If-None-Match may hold a list of tags, weak tags or "*"
+static bool matchesETag(AsyncWebServerRequest *request, const String& etag) {
+    AsyncWebHeader* header = request->getHeader("If-None-Match");
+    if (!header) {
+        return false;
+    }
+    const String& value = header->value();
+    return value == "*" || value.indexOf(etag) >= 0;
+}
+
+void registerMaterialAssets(AsyncWebServer* server) {
+    server->on(MATERIAL_CSS_PATH, HTTP_GET, [](AsyncWebServerRequest *request) {
+        String etag = getMaterialETag();
+        AsyncWebServerResponse *response;
+
+        if (matchesETag(request, etag)) {
+            // Unchanged, headers only
+            response = request->beginResponse(304);
+        } else {
+            // Sent straight from flash, the stylesheet is never copied to RAM
+            response = request->beginResponse_P(200, "text/css",
+                (const uint8_t*)MATERIAL_CSS, MATERIAL_CSS_LENGTH);
+        }
+
+        response->addHeader("ETag", etag);
+        response->addHeader("Cache-Control", ASSET_CACHE_CONTROL);
+        request->send(response);
+    });
+}
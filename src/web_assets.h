@@ -0,0 +1,17 @@
+#ifndef WEB_ASSETS_H
+#define WEB_ASSETS_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+
+#define MATERIAL_CSS_PATH "/material.css"
+
+// Assets are versioned by content hash in the page URL, so browsers may keep
+// them forever and only ever revalidate on an explicit reload
+#define ASSET_CACHE_CONTROL "public, max-age=31536000, immutable"
+
+// Serve the shared Material stylesheet with ETag and 304 revalidation.
+// Pages built with MaterialPage::getHeader() link to it.
+void registerMaterialAssets(AsyncWebServer* server);
+
+#endif
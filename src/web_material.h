@@ -4,7 +4,8 @@
 #include <Arduino.h>
 
 // Material Design CSS - Reusable for all web pages
-const char MATERIAL_CSS[] PROGMEM = R"css(
+// Served as /material.css by registerMaterialAssets(), see web_assets.h
+inline constexpr char MATERIAL_CSS[] PROGMEM = R"css(
 /* Material Design Variables */
 :root {
     --md-primary: #4a4a4a;
@@ -323,16 +324,34 @@ button:disabled,
 }
 )css";
 
+// FNV-1a hash of the stylesheet, changes whenever the CSS changes.
+// Used as cache-busting version and ETag of /material.css.
+constexpr uint32_t materialHash(const char* data, size_t length) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ (uint8_t)data[i]) * 16777619u;
+    }
+    return hash;
+}
+
+constexpr size_t MATERIAL_CSS_LENGTH = sizeof(MATERIAL_CSS) - 1;
+constexpr uint32_t MATERIAL_CSS_HASH = materialHash(MATERIAL_CSS, MATERIAL_CSS_LENGTH);
+
 // Helper class to build Material Design HTML pages
 class MaterialPage {
 public:
-    // Generate HTML page header with Material CSS
+    // Generate HTML page header linking the cached Material stylesheet
     static String getHeader(const String& title, const String& themeColor = "#4a4a4a") {
-        String html = "<!DOCTYPE html><html lang=\"en\"><head>";
-        html += "<meta charset=\"UTF-8\">";
-        html += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0, maximum-scale=1.0, user-scalable=no\">";
-        html += "<meta name=\"theme-color\" content=\"" + themeColor + "\">";
-        html += "<title>" + title + "</title>";
+        String html = getHead(title, themeColor);
+        html += "<link rel=\"stylesheet\" href=\"/material.css?v=" + String(MATERIAL_CSS_HASH, HEX) + "\">";
+        html += "</head><body>";
+        return html;
+    }
+
+    // Generate HTML page header with inlined Material CSS, for the captive
+    // portal where OS probe browsers may not load a second resource
+    static String getInlineHeader(const String& title, const String& themeColor = "#4a4a4a") {
+        String html = getHead(title, themeColor);
         html += "<style>" + String(MATERIAL_CSS) + "</style>";
         html += "</head><body>";
         return html;
@@ -432,6 +451,16 @@ public:
         html += "</div>";
         return html;
     }
+
+private:
+    static String getHead(const String& title, const String& themeColor) {
+        String html = "<!DOCTYPE html><html lang=\"en\"><head>";
+        html += "<meta charset=\"UTF-8\">";
+        html += "<meta name=\"viewport\" content=\"width=device-width, initial-scale=1.0, maximum-scale=1.0, user-scalable=no\">";
+        html += "<meta name=\"theme-color\" content=\"" + themeColor + "\">";
+        html += "<title>" + title + "</title>";
+        return html;
+    }
 };
 
 #endif
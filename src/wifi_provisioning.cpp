@@ -2,17 +2,23 @@
 #include "portal_material.h"
 #include "web_material.h"
 #include "homeServer.h"
+#include "log_buffer.h"
+#include "web_admission.h"
+#include "credential_store.h"
+#include "wifi_scan.h"
+#include "profiler.h"
 
 #define WIFI_TIMEOUT_MS 20000
 #define AP_TIMEOUT_MS 300000  // 5 minutes
 
-WiFiProvisioning::WiFiProvisioning() : server(nullptr), apMode(false) {}
+WiFiProvisioning::WiFiProvisioning()
+    : server(nullptr), apMode(false), clientJoinedMillis(0), clientJoinedEvent(0) {}
 
 bool WiFiProvisioning::begin() {
     String ssid, password;
 
     // Try to load saved credentials
-    if (loadCredentials(ssid, password)) {
+    if (loadWifiCredentials(ssid, password)) {
         Serial.println("Found saved WiFi credentials");
         Serial.printf("SSID: %s\n", ssid.c_str());
 
@@ -33,7 +39,20 @@ bool WiFiProvisioning::begin() {
 }
 
 void WiFiProvisioning::loop() {
-    // Reserved for future use (e.g., AP timeout handling)
+    if (!apMode) {
+        return;
+    }
+
+    // Connecting from the portal switches the radio to station mode
+    if (!(WiFi.getMode() & WIFI_MODE_AP)) {
+        stopConfigPortal();
+        return;
+    }
+
+#if CAPTIVE_DNS
+    PROFILE_SCOPE(PROFILE_DNS);
+    dns.loop();
+#endif
 }
 
 bool WiFiProvisioning::isConnected() {
@@ -54,32 +73,14 @@ int WiFiProvisioning::getRSSI() {
 
 void WiFiProvisioning::reset() {
     Serial.println("Resetting WiFi credentials");
-    prefs.begin("wifi", false);
-    prefs.clear();
-    prefs.end();
+    clearWifiCredentials();
     WiFi.disconnect(true);
     ESP.restart();
 }
 
-bool WiFiProvisioning::loadCredentials(String& ssid, String& password) {
-    prefs.begin("wifi", true);  // Read-only
-    ssid = prefs.getString("ssid", "");
-    password = prefs.getString("password", "");
-    prefs.end();
-
-    return (ssid.length() > 0);
-}
-
-void WiFiProvisioning::saveCredentials(const String& ssid, const String& password) {
-    prefs.begin("wifi", false);  // Read-write
-    prefs.putString("ssid", ssid);
-    prefs.putString("password", password);
-    prefs.end();
-    Serial.println("WiFi credentials saved");
-}
-
 bool WiFiProvisioning::connectToWiFi(const String& ssid, const String& password) {
-    Serial.printf("Connecting to WiFi: %s\n", ssid.c_str());
+    // Also runs in the /connect handler, so log through the ring buffer
+    logEvent(LOG_WIFI_CONNECTING, ssid);
 
     WiFi.mode(WIFI_STA);
     WiFi.begin(ssid.c_str(), password.c_str());
@@ -87,17 +88,14 @@ bool WiFiProvisioning::connectToWiFi(const String& ssid, const String& password)
     unsigned long startTime = millis();
     while (WiFi.status() != WL_CONNECTED && millis() - startTime < WIFI_TIMEOUT_MS) {
         delay(500);
-        Serial.print(".");
     }
-    Serial.println();
 
     if (WiFi.status() == WL_CONNECTED) {
-        Serial.println("WiFi connected!");
-        Serial.printf("IP Address: %s\n", WiFi.localIP().toString().c_str());
-        Serial.printf("Signal Strength: %d dBm\n", WiFi.RSSI());
+        logEvent(LOG_WIFI_CONNECTED, WiFi.localIP().toString(), WiFi.RSSI());
         return true;
     }
 
+    logEvent(LOG_WIFI_FAILED, millis() - startTime);
     return false;
 }
 
@@ -122,13 +120,46 @@ void WiFiProvisioning::startConfigPortal() {
     WiFi.mode(WIFI_AP);
     WiFi.softAP(apName.c_str());
 
+    // Time-to-portal is measured from the moment a client joins
+    if (clientJoinedEvent == 0) {
+        clientJoinedEvent = WiFi.onEvent([this](WiFiEvent_t, WiFiEventInfo_t) {
+            clientJoinedMillis = millis();
+            logEvent(LOG_AP_CLIENT_JOINED, WiFi.softAPgetStationNum());
+        }, ARDUINO_EVENT_WIFI_AP_STACONNECTED);
+    }
+
     // Small delay to let AP start
     delay(100);
 
+#if CAPTIVE_DNS
+    // Resolve every host to the portal, clients that do not use the probe
+    // URLs of their OS find the portal too
+    if (dns.begin(WiFi.softAPIP())) {
+        Serial.println("DNS server started");
+    } else {
+        Serial.println("Failed to start DNS server");
+    }
+#endif
+
     // Setup web server
     setupWebServer();
 }
 
+// Called from loop(), the task that polls the DNS socket
+void WiFiProvisioning::stopConfigPortal() {
+    apMode = false;
+
+    if (clientJoinedEvent != 0) {
+        WiFi.removeEvent(clientJoinedEvent);
+        clientJoinedEvent = 0;
+    }
+
+#if CAPTIVE_DNS
+    dns.stop();
+#endif
+    Serial.println("Configuration portal stopped");
+}
+
 void WiFiProvisioning::setupWebServer() {
     if (server) {
         delete server;
@@ -136,53 +167,76 @@ void WiFiProvisioning::setupWebServer() {
 
     server = new AsyncWebServer(80);
 
-    // Get portal HTML once
-    String portalHTML = getPortalHTML();
+    // 503 when too busy or low on heap, before any route
+    addAdmissionControl(server);
+
+    // Get portal HTML once, shared by all handlers
+    portalHTML = getPortalHTML();
 
     // Captive Portal Detection Endpoints - Serve portal page directly
     // Android
-    server->on("/generate_204", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/generate_204", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
-    server->on("/gen_204", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/gen_204", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
 
     // iOS/macOS - Must return specific content
-    server->on("/hotspot-detect.html", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/hotspot-detect.html", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
-    server->on("/library/test/success.html", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/library/test/success.html", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
 
     // Windows
-    server->on("/connecttest.txt", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/connecttest.txt", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
-    server->on("/ncsi.txt", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/ncsi.txt", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
 
     // Serve configuration page at root
-    server->on("/", HTTP_GET, [portalHTML](AsyncWebServerRequest *request) {
-        request->send(200, "text/html", portalHTML);
+    server->on("/", HTTP_GET, [this](AsyncWebServerRequest *request) {
+        sendPortal(request);
     });
 
     // Scan for WiFi networks
     server->on("/scan", HTTP_GET, [](AsyncWebServerRequest *request) {
-        Serial.println("Scanning for WiFi networks...");
+        PROFILE_SCOPE(PROFILE_HTTP_SCAN);
+        logEvent(LOG_SCAN_START);
+        unsigned long scanStart = millis();
         int n = WiFi.scanNetworks();
-        String json = "[";
+        logEvent(LOG_SCAN_DONE, n, millis() - scanStart);
+
+        // Every chunk renders the array again from this response's copy of
+        // the records and keeps only its own part, the JSON is not buffered
+        ScanResults networks = copyScanResults(n);
+        request->send(request->beginChunkedResponse("application/json",
+            [networks](uint8_t *buffer, size_t maxLen, size_t index) -> size_t {
+                JsonWriter json((char*)buffer, maxLen, index);
+                writeScanJSON(json, *networks);
+                return json.written();
+            }));
+    });
 
-        for (int i = 0; i < n; i++) {
-            if (i > 0) json += ",";
-            json += "{\"ssid\":\"" + WiFi.SSID(i) + "\",\"rssi\":" + String(WiFi.RSSI(i)) + "}";
-        }
-        json += "]";
+    // Recent log lines
+    server->on("/api/log", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", getLogHistory());
+    });
 
-        request->send(200, "application/json", json);
+#if PROFILING
+    // Task and section profile, see docs/PROFILING.md
+    server->on("/api/profile", HTTP_GET, [](AsyncWebServerRequest *request) {
+        request->send(200, "text/plain", getProfileReport());
+    });
+    server->on("/api/profile", HTTP_DELETE, [](AsyncWebServerRequest *request) {
+        resetProfile();
+        request->send(200, "application/json", "{\"success\":true}");
     });
+#endif
 
     // Handle WiFi connection request
     server->on("/connect", HTTP_POST, [this](AsyncWebServerRequest *request) {
@@ -201,10 +255,10 @@ void WiFiProvisioning::setupWebServer() {
             return;
         }
 
-        Serial.printf("Attempting to connect to: %s\n", ssid.c_str());
+        logEvent(LOG_CONNECT_REQUEST, ssid);
 
         // Save credentials
-        saveCredentials(ssid, password);
+        saveWifiCredentials(ssid, password);
 
         // Try to connect
         bool connected = connectToWiFi(ssid, password);
@@ -219,16 +273,28 @@ void WiFiProvisioning::setupWebServer() {
     });
 
     // Catch-all handler - serve portal page for all unmatched requests
-    server->onNotFound([portalHTML](AsyncWebServerRequest *request) {
-        // Log request for debugging
-        Serial.printf("Captive portal request: %s %s\n",
-                     request->methodToString(),
-                     request->url().c_str());
+    server->onNotFound([this](AsyncWebServerRequest *request) {
+        // Log request for debugging, without blocking the AsyncTCP task
+        logEvent(LOG_PORTAL_REQUEST, request->methodToString(), request->url());
 
         // Serve portal page for any unmatched request
-        request->send(200, "text/html", portalHTML);
+        sendPortal(request);
     });
 
     server->begin();
     Serial.println("Web server started");
 }
+
+void WiFiProvisioning::sendPortal(AsyncWebServerRequest *request) {
+    PROFILE_SCOPE(PROFILE_HTTP_PAGE);
+
+    // First portal page after a client joined, see docs/CAPTIVE_PORTAL.md
+    unsigned long joined = clientJoinedMillis;
+    if (joined != 0) {
+        clientJoinedMillis = 0;
+        logEvent(LOG_PORTAL_SERVED, millis() - joined);
+    }
+
+    // Streamed from the member, not copied into every response
+    request->send_P(200, "text/html", (const uint8_t*)portalHTML.c_str(), portalHTML.length());
+}
@@ -3,8 +3,8 @@
 
 #include <Arduino.h>
 #include <WiFi.h>
-#include <Preferences.h>
 #include <ESPAsyncWebServer.h>
+#include "captive_dns.h"
 
 class WiFiProvisioning {
 public:
@@ -18,15 +18,18 @@ public:
     void reset();
 
 private:
-    Preferences prefs;
     AsyncWebServer* server;
+    CaptiveDns dns;
     bool apMode;
+    String portalHTML;
+    volatile unsigned long clientJoinedMillis;  // For the time-to-portal log
+    wifi_event_id_t clientJoinedEvent;          // 0 while not registered
 
-    bool loadCredentials(String& ssid, String& password);
-    void saveCredentials(const String& ssid, const String& password);
     bool connectToWiFi(const String& ssid, const String& password);
     void startConfigPortal();
+    void stopConfigPortal();
     void setupWebServer();
+    void sendPortal(AsyncWebServerRequest *request);
 };
 
 #endif
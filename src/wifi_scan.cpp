@@ -0,0 +1,40 @@
+#include "wifi_scan.h"
+#include <WiFi.h>
+
+ScanResults copyScanResults(int networks) {
+    std::shared_ptr<std::vector<ScanNetwork>> results = std::make_shared<std::vector<ScanNetwork>>();
+    // Negative when the scan failed
+    if (networks <= 0) {
+        return results;
+    }
+
+    results->reserve(networks);
+    for (int i = 0; i < networks; i++) {
+        const wifi_ap_record_t* ap = (const wifi_ap_record_t*)WiFi.getScanInfoByIndex(i);
+        if (!ap) {
+            break;
+        }
+
+        ScanNetwork network;
+        memcpy(network.ssid, ap->ssid, sizeof(network.ssid));
+        network.rssi = ap->rssi;
+        results->push_back(network);
+    }
+    return results;
+}
+
+void writeScanJSON(JsonWriter& json, const std::vector<ScanNetwork>& networks) {
+    json.beginArray();
+
+    // Stop once the chunk is complete, later networks are not needed
+    for (size_t i = 0; i < networks.size() && !json.full(); i++) {
+        const ScanNetwork& network = networks[i];
+        json.beginObject();
+        json.key("ssid");
+        json.value(network.ssid, strnlen(network.ssid, sizeof(network.ssid)));
+        json.member("rssi", network.rssi);
+        json.endObject();
+    }
+
+    json.endArray();
+}
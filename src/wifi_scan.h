@@ -0,0 +1,26 @@
+#ifndef WIFI_SCAN_H
+#define WIFI_SCAN_H
+
+#include <Arduino.h>
+#include <memory>
+#include <vector>
+#include "json_writer.h"
+
+struct ScanNetwork {
+    char ssid[33];  // As in wifi_ap_record_t
+    int8_t rssi;
+};
+
+// Networks of one scan, shared by the chunks of one response
+typedef std::shared_ptr<const std::vector<ScanNetwork>> ScanResults;
+
+// Copies the records of the last WiFi.scanNetworks(). The next scan
+// replaces the driver's records, possibly while an earlier response is
+// still being streamed, so every response renders its own copy.
+ScanResults copyScanResults(int networks);
+
+// Networks as JSON array for the portal, [{"ssid":"...","rssi":-60},...].
+// Allocates nothing, so it can run once per chunk of a chunked response.
+void writeScanJSON(JsonWriter& json, const std::vector<ScanNetwork>& networks);
+
+#endif
@@ -0,0 +1,166 @@
+#!/usr/bin/env python3
+"""Assembler for Smart Home Light effect scripts.
+
+Translates an effect assembly file (.fxa) into the bytecode format run by
+ScriptEffect (src/effect_vm.h) and optionally uploads it to a lamp.
+
+    tools/effect_asm.py tools/effects/ambient_wave.fxa -o ambient_wave.fx
+    tools/effect_asm.py tools/effects/ambient_wave.fxa --upload 192.168.1.50
+    tools/effect_asm.py tools/effects/ambient_wave.fxa --c-array
+
+Syntax: one instruction per line, ';' starts a comment, 'name:' defines a
+label. The labels 'pixel' (required) and 'frame' (optional) are the entry
+points. Numbers are decimal and converted to Q16.16 fixed point.
+"""
+
+import argparse
+import struct
+import sys
+import urllib.request
+
+MAGIC = b"FX"
+VERSION = 1
+NO_ENTRY = 0xFFFF
+MAX_PROGRAM_SIZE = 1024
+REGISTERS = 16
+
+# Keep in sync with EffectOpcode in src/effect_vm.h
+OPCODES = {
+    "end": 0x00, "push": 0x01, "dup": 0x02, "drop": 0x03, "swap": 0x04, "over": 0x05,
+    "add": 0x10, "sub": 0x11, "mul": 0x12, "div": 0x13, "mod": 0x14, "neg": 0x15,
+    "abs": 0x16, "min": 0x17, "max": 0x18, "floor": 0x19, "fract": 0x1A, "clamp": 0x1B,
+    "lt": 0x20, "gt": 0x21, "eq": 0x22, "not": 0x23,
+    "sin": 0x28, "noise": 0x29,
+    "time": 0x30, "index": 0x31, "count": 0x32, "pos": 0x33,
+    "load": 0x38, "store": 0x39,
+    "jmp": 0x40, "jz": 0x41,
+    "rgbw": 0x48, "rgb": 0x49,
+}
+
+OPERAND_SIZE = {"push": 4, "load": 1, "store": 1, "jmp": 2, "jz": 2}
+
+
+class AsmError(Exception):
+    pass
+
+
+def to_fixed(text):
+    value = round(float(text) * 65536)
+    if not -2**31 <= value < 2**31:
+        raise AsmError(f"value out of range: {text}")
+    return value
+
+
+def parse(source):
+    """Returns a list of (line number, mnemonic, operand) and the label map."""
+    instructions = []
+    labels = {}
+    offset = 0
+
+    for number, line in enumerate(source.splitlines(), 1):
+        line = line.split(";", 1)[0].strip()
+        if not line:
+            continue
+
+        if line.endswith(":"):
+            name = line[:-1].strip()
+            if name in labels:
+                raise AsmError(f"line {number}: duplicate label '{name}'")
+            labels[name] = offset
+            continue
+
+        parts = line.split()
+        mnemonic = parts[0].lower()
+        if mnemonic not in OPCODES:
+            raise AsmError(f"line {number}: unknown instruction '{parts[0]}'")
+
+        size = OPERAND_SIZE.get(mnemonic, 0)
+        if size and len(parts) != 2:
+            raise AsmError(f"line {number}: '{mnemonic}' needs one operand")
+        if not size and len(parts) != 1:
+            raise AsmError(f"line {number}: '{mnemonic}' takes no operand")
+
+        instructions.append((number, mnemonic, parts[1] if size else None))
+        offset += 1 + size
+
+    return instructions, labels
+
+
+def assemble(source):
+    instructions, labels = parse(source)
+    code = bytearray()
+
+    for number, mnemonic, operand in instructions:
+        code.append(OPCODES[mnemonic])
+        if mnemonic == "push":
+            try:
+                code += struct.pack("<i", to_fixed(operand))
+            except ValueError:
+                raise AsmError(f"line {number}: invalid number '{operand}'")
+        elif mnemonic in ("load", "store"):
+            try:
+                register = int(operand.lstrip("r"))
+            except ValueError:
+                raise AsmError(f"line {number}: invalid register '{operand}'")
+            if not 0 <= register < REGISTERS:
+                raise AsmError(f"line {number}: invalid register '{operand}'")
+            code.append(register)
+        elif mnemonic in ("jmp", "jz"):
+            if operand not in labels:
+                raise AsmError(f"line {number}: unknown label '{operand}'")
+            code += struct.pack("<H", labels[operand])
+
+    if "pixel" not in labels:
+        raise AsmError("missing 'pixel:' entry")
+    if not instructions or instructions[-1][1] not in ("end", "jmp"):
+        raise AsmError("program must end with 'end' or 'jmp'")
+
+    header = MAGIC + struct.pack("<BHH", VERSION, labels["pixel"], labels.get("frame", NO_ENTRY))
+    program = header + bytes(code)
+    if len(program) > MAX_PROGRAM_SIZE:
+        raise AsmError(f"program too large: {len(program)} > {MAX_PROGRAM_SIZE} bytes")
+    return program
+
+
+def c_array(program, name):
+    lines = [f"static const uint8_t {name}[] = {{"]
+    for i in range(0, len(program), 12):
+        lines.append("    " + ", ".join(f"0x{b:02x}" for b in program[i:i + 12]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def upload(program, host):
+    request = urllib.request.Request(f"http://{host}/api/effect", data=program, method="POST",
+                                     headers={"Content-Type": "application/octet-stream"})
+    with urllib.request.urlopen(request, timeout=10) as response:
+        print(response.read().decode())
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Assemble an effect script")
+    parser.add_argument("source", help="effect assembly file (.fxa)")
+    parser.add_argument("-o", "--output", help="write bytecode to this file")
+    parser.add_argument("--c-array", action="store_true", help="print bytecode as C array")
+    parser.add_argument("--upload", metavar="HOST", help="upload to the lamp at HOST")
+    args = parser.parse_args()
+
+    with open(args.source) as f:
+        try:
+            program = assemble(f.read())
+        except AsmError as e:
+            sys.exit(f"{args.source}: {e}")
+
+    print(f"{args.source}: {len(program)} bytes", file=sys.stderr)
+
+    if args.output:
+        with open(args.output, "wb") as f:
+            f.write(program)
+    if args.c_array:
+        print(c_array(program, "EFFECT_PROGRAM"))
+    if args.upload:
+        upload(program, args.upload)
+
+
+if __name__ == "__main__":
+    main()
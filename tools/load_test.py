@@ -0,0 +1,160 @@
+#!/usr/bin/env python3
+"""Load generator for the lamp's web server.
+
+Keeps a number of clients requesting pages at the same time and, next to
+them, a canary client that requests one page per second. The server holds
+up when it keeps answering, 200 or 503 with Retry-After, and the canary
+gets through after backing off.
+
+    tools/load_test.py 192.168.1.50
+    tools/load_test.py 192.168.4.1 --clients 32 --duration 120 --path /scan
+    tools/load_test.py 192.168.1.50 --path / --path /material.css --path /api/log
+
+Exits with 1 when the lamp stops answering (connection errors or timeouts
+of the canary) or is not reachable after the run.
+"""
+
+import argparse
+import random
+import statistics
+import sys
+import threading
+import time
+import urllib.error
+import urllib.request
+
+TIMEOUT = 10
+
+
+class Stats:
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.status = {}
+        self.errors = {}
+        self.latencies = []
+        self.retry_after_missing = 0
+
+    def add(self, status, latency, retry_after=None):
+        with self.lock:
+            self.status[status] = self.status.get(status, 0) + 1
+            self.latencies.append(latency)
+            if status == 503 and retry_after is None:
+                self.retry_after_missing += 1
+
+    def error(self, kind):
+        with self.lock:
+            self.errors[kind] = self.errors.get(kind, 0) + 1
+
+
+def request(url):
+    """Returns (status, latency, Retry-After header) or raises on network errors."""
+    start = time.monotonic()
+    try:
+        with urllib.request.urlopen(url, timeout=TIMEOUT) as response:
+            response.read()
+            return response.status, time.monotonic() - start, None
+    except urllib.error.HTTPError as e:
+        e.read()
+        return e.code, time.monotonic() - start, e.headers.get("Retry-After")
+
+
+def worker(base, paths, stop, stats):
+    while not stop.is_set():
+        try:
+            status, latency, retry_after = request(base + random.choice(paths))
+            stats.add(status, latency, retry_after)
+        except (urllib.error.URLError, OSError) as e:
+            stats.error(type(getattr(e, "reason", e)).__name__)
+
+
+def canary(base, path, stop, stats):
+    """One well-behaved client, honours Retry-After."""
+    while not stop.is_set():
+        try:
+            status, latency, retry_after = request(base + path)
+            stats.add(status, latency, retry_after)
+            if status == 503:
+                stop.wait(float(retry_after or 1))
+                continue
+        except (urllib.error.URLError, OSError) as e:
+            stats.error(type(getattr(e, "reason", e)).__name__)
+        stop.wait(1)
+
+
+def percentile(values, p):
+    if not values:
+        return 0.0
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def report(name, stats, duration):
+    total = sum(stats.status.values())
+    errors = sum(stats.errors.values())
+    print(f"{name}:")
+    print(f"  requests   {total} ({total / duration:.1f}/s), network errors {errors}")
+    print(f"  status     " + ", ".join(f"{code}: {count}" for code, count in sorted(stats.status.items())))
+    if stats.errors:
+        print(f"  errors     " + ", ".join(f"{kind}: {count}" for kind, count in sorted(stats.errors.items())))
+    if stats.latencies:
+        print(f"  latency ms p50 {percentile(stats.latencies, 50) * 1000:.0f}, "
+              f"p99 {percentile(stats.latencies, 99) * 1000:.0f}, "
+              f"max {max(stats.latencies) * 1000:.0f}, "
+              f"mean {statistics.mean(stats.latencies) * 1000:.0f}")
+    if stats.retry_after_missing:
+        print(f"  503 without Retry-After: {stats.retry_after_missing}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Sustained concurrent load on the lamp's web server")
+    parser.add_argument("host", help="lamp address, e.g. 192.168.1.50 or 192.168.4.1:80")
+    parser.add_argument("--clients", type=int, default=16, help="concurrent clients (default 16)")
+    parser.add_argument("--duration", type=float, default=60, help="seconds (default 60)")
+    parser.add_argument("--path", action="append", help="paths to request, repeatable (default /)")
+    parser.add_argument("--canary", default="/", help="path requested by the canary (default /)")
+    args = parser.parse_args()
+
+    base = args.host if args.host.startswith("http") else f"http://{args.host}"
+    paths = args.path or ["/"]
+
+    load, watch = Stats(), Stats()
+    stop = threading.Event()
+    threads = [threading.Thread(target=worker, args=(base, paths, stop, load), daemon=True)
+               for _ in range(args.clients)]
+    threads.append(threading.Thread(target=canary, args=(base, args.canary, stop, watch), daemon=True))
+
+    print(f"{args.clients} clients on {base} {', '.join(paths)} for {args.duration:g} s")
+    start = time.monotonic()
+    for thread in threads:
+        thread.start()
+    try:
+        stop.wait(args.duration)
+    except KeyboardInterrupt:
+        pass
+    stop.set()
+    for thread in threads:
+        thread.join(TIMEOUT + 1)
+    duration = time.monotonic() - start
+
+    report("Load", load, duration)
+    report("Canary", watch, duration)
+
+    # The lamp must still answer once the load is gone
+    time.sleep(2)
+    try:
+        status, latency, _ = request(base + args.canary)
+        print(f"After load: {status} in {latency * 1000:.0f} ms")
+        alive = status == 200
+    except (urllib.error.URLError, OSError) as e:
+        print(f"After load: not reachable ({e})")
+        alive = False
+
+    served = watch.status.get(200, 0)
+    if not alive or watch.errors or served == 0:
+        print("FAILED: server stopped answering")
+        sys.exit(1)
+    print("Server stayed up")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,123 @@
+#!/usr/bin/env python3
+"""Host benchmarks of the web and provisioning layer and of the effects.
+
+Builds bench/bench_main.cpp with the host shims in bench/host, runs it and
+checks allocation count and peak heap of every benchmark against
+bench/thresholds.json.
+
+    tools/run_benchmarks.py                       # build, run, check
+    tools/run_benchmarks.py -o results.json       # also keep the results
+    tools/run_benchmarks.py --update-thresholds   # accept the current numbers
+
+Thresholds are the accepted numbers plus 50 %, so a change that doubles
+allocations or peak heap fails the run. Time is reported but not checked,
+it depends on the machine.
+"""
+
+import argparse
+import json
+import math
+import os
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BUILD_DIR = os.path.join(ROOT, ".bench")
+THRESHOLDS = os.path.join(ROOT, "bench", "thresholds.json")
+
+SOURCES = [
+    "bench/bench_main.cpp",
+    "bench/host/host_alloc.cpp",
+    "src/credential_store.cpp",
+    "src/wifi_scan.cpp",
+    "src/log_buffer.cpp",
+    "src/json_writer.cpp",
+    "src/device_state.cpp",
+    "src/lamp_sync.cpp",
+    "src/frame_buffer.cpp",
+    "src/effect_vm.cpp",
+    "src/native_effects.cpp",
+    "src/segment_renderer.cpp",
+]
+
+CHECKED = ("allocations", "peak_bytes")
+MARGIN = 1.5
+
+
+def build():
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    binary = os.path.join(BUILD_DIR, "bench")
+    command = [os.environ.get("CXX", "g++"), "-std=gnu++17", "-O2", "-Wall",
+               "-I", os.path.join(ROOT, "bench", "host"), "-I", os.path.join(ROOT, "src"),
+               *[os.path.join(ROOT, source) for source in SOURCES],
+               "-o", binary, "-lpthread"]
+    subprocess.run(command, check=True)
+    return binary
+
+
+def run(binary):
+    output = subprocess.run([binary], check=True, capture_output=True, text=True).stdout
+    # Serial output of the code under test comes before the results
+    return json.loads(output[output.index('{\n  "benchmarks"'):])["benchmarks"]
+
+
+def check(results, thresholds):
+    failures = []
+    for result in results:
+        limits = thresholds.get(result["name"])
+        if limits is None:
+            failures.append(f"{result['name']}: no threshold, run with --update-thresholds")
+            continue
+        for key in CHECKED:
+            if result[key] > limits[key]:
+                failures.append(f"{result['name']}: {key} {result[key]:g} > {limits[key]:g}")
+    return failures
+
+
+def print_table(results, thresholds):
+    print(f"{'benchmark':<28} {'time us':>10} {'allocs':>8} {'limit':>6} {'peak B':>8} {'limit':>7}")
+    for result in results:
+        limits = thresholds.get(result["name"], {})
+        print(f"{result['name']:<28} {result['time_us']:>10.3f} "
+              f"{result['allocations']:>8g} {limits.get('allocations', '-'):>6} "
+              f"{result['peak_bytes']:>8} {limits.get('peak_bytes', '-'):>7}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Run the host benchmarks")
+    parser.add_argument("-o", "--output", help="write the results as JSON to this file")
+    parser.add_argument("--update-thresholds", action="store_true",
+                        help="write thresholds from the current results")
+    args = parser.parse_args()
+
+    results = run(build())
+
+    if args.output:
+        with open(args.output, "w") as f:
+            json.dump({"benchmarks": results}, f, indent=2)
+            f.write("\n")
+
+    if args.update_thresholds:
+        thresholds = {r["name"]: {key: math.ceil(r[key] * MARGIN) for key in CHECKED}
+                      for r in results}
+        with open(THRESHOLDS, "w") as f:
+            json.dump(thresholds, f, indent=2)
+            f.write("\n")
+        print(f"Updated {os.path.relpath(THRESHOLDS, ROOT)}")
+
+    with open(THRESHOLDS) as f:
+        thresholds = json.load(f)
+
+    print_table(results, thresholds)
+
+    failures = check(results, thresholds)
+    if failures:
+        print("\nFAILED:")
+        for failure in failures:
+            print(f"  {failure}")
+        sys.exit(1)
+    print("\nAll benchmarks within thresholds")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,204 @@
+#!/usr/bin/env python3
+"""Multi-lamp clock sync test on one Linux machine.
+
+Builds bench/sync_main.cpp with the host shims in bench/host and starts
+several lamps on the loopback interface, each with its own clock offset
+and crystal drift. One lamp starts a scene and another one ends it, then
+the run checks that
+
+- every follower's shared clock matches the master's (sync error),
+- all lamps render each scene frame at the same real time (frame skew), and
+- every lamp stops rendering scene frames once the scene ended.
+
+    tools/sync_test.py                          # 4 lamps, 15 s
+    tools/sync_test.py --lamps 8 --duration 30
+    tools/sync_test.py --seed 7 -v              # reproducible, with lamp logs
+
+Exits with 1 when the error or skew exceeds the limits, a lamp has no
+frames of the scene or still renders them after the end.
+"""
+
+import argparse
+import bisect
+import json
+import os
+import random
+import statistics
+import subprocess
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+BUILD_DIR = os.path.join(ROOT, ".bench")
+SCENE_END_SLACK = 100_000  # us for the end to reach every lamp
+
+SOURCES = [
+    "bench/sync_main.cpp",
+    "bench/host/host_alloc.cpp",
+    "src/lamp_sync.cpp",
+    "src/log_buffer.cpp",
+]
+
+
+def build():
+    os.makedirs(BUILD_DIR, exist_ok=True)
+    binary = os.path.join(BUILD_DIR, "sync_lamp")
+    command = [os.environ.get("CXX", "g++"), "-std=gnu++17", "-O2", "-Wall",
+               "-I", os.path.join(ROOT, "bench", "host"), "-I", os.path.join(ROOT, "src"),
+               *[os.path.join(ROOT, source) for source in SOURCES],
+               "-o", binary, "-lpthread"]
+    subprocess.run(command, check=True)
+    return binary
+
+
+def run_lamps(binary, args):
+    rng = random.Random(args.seed)
+    lamps = []
+    for i in range(args.lamps):
+        lamp = {
+            "id": i + 1,
+            "offset_us": rng.randint(-10_000_000, 10_000_000),
+            "drift_ppm": round(rng.uniform(-args.max_drift, args.max_drift), 1),
+        }
+        command = [binary, "--id", str(lamp["id"]), "--offset-us", str(lamp["offset_us"]),
+                   "--drift-ppm", str(lamp["drift_ppm"]), "--duration", str(args.duration)]
+        # The last lamp, a follower, starts the scene
+        if i == args.lamps - 1:
+            command += ["--scene-at", str(args.scene_at), "--scene-delay", str(args.scene_delay)]
+        # The first lamp ends it, usually the master
+        if i == 0 and args.scene_end_at >= 0:
+            command += ["--scene-end-at", str(args.scene_end_at)]
+        lamp["process"] = subprocess.Popen(command, stdout=subprocess.PIPE, text=True)
+        lamps.append(lamp)
+
+    for lamp in lamps:
+        output, _ = lamp["process"].communicate()
+        lamp["returncode"] = lamp["process"].returncode
+        lamp["clock"] = []
+        lamp["frames"] = {}
+        lamp["log"] = []
+        for line in output.splitlines():
+            if not line.startswith("{"):
+                lamp["log"].append(line)
+                continue
+            record = json.loads(line)
+            if record["type"] == "clock":
+                lamp["clock"].append(record)
+            elif record["type"] == "scene_end":
+                lamp["scene_end"] = record["real"]
+            else:
+                lamp["frames"][record["frame"]] = record["real"]
+    return lamps
+
+
+def master_shared(master, real):
+    """Master's shared time at a real time, its clock is linear in between reports."""
+    clock = master["clock"]
+    reals = [record["real"] for record in clock]
+    i = bisect.bisect_left(reals, real)
+    if i == 0 or i == len(clock):
+        return None
+    a, b = clock[i - 1], clock[i]
+    return a["shared"] + (b["shared"] - a["shared"]) * (real - a["real"]) / (b["real"] - a["real"])
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100))]
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Test multicast clock sync with host lamps")
+    parser.add_argument("--lamps", type=int, default=4)
+    parser.add_argument("--duration", type=float, default=15, help="seconds")
+    parser.add_argument("--settle", type=float, default=8,
+                        help="seconds before the sync error is checked")
+    parser.add_argument("--scene-at", type=float, default=9, help="seconds")
+    parser.add_argument("--scene-delay", type=int, default=500, help="ms")
+    parser.add_argument("--scene-end-at", type=float, default=13,
+                        help="seconds, negative to keep the scene running")
+    parser.add_argument("--max-drift", type=float, default=50, help="ppm, random per lamp")
+    parser.add_argument("--max-error", type=float, default=1000, help="us, 95th percentile")
+    parser.add_argument("--max-skew", type=float, default=3000, help="us, 95th percentile")
+    parser.add_argument("--seed", type=int)
+    parser.add_argument("-v", "--verbose", action="store_true", help="print the lamp logs")
+    args = parser.parse_args()
+    if args.scene_at >= args.duration:
+        parser.error("--scene-at must be before --duration")
+    if args.scene_end_at >= 0:
+        if args.scene_end_at >= args.duration:
+            parser.error("--scene-end-at must be before --duration, or negative to keep the scene running")
+        if args.scene_at >= args.scene_end_at:
+            parser.error("--scene-at must be before --scene-end-at")
+
+    lamps = run_lamps(build(), args)
+    failures = []
+
+    masters = {lamp["clock"][-1]["master"] for lamp in lamps if lamp["clock"]}
+    if len(masters) != 1:
+        failures.append(f"lamps disagree on the master: {sorted(masters)}")
+    master = next((lamp for lamp in lamps if lamp["id"] in masters), lamps[0])
+
+    print(f"{'lamp':>4} {'offset s':>9} {'drift ppm':>9} {'role':>9} "
+          f"{'error p50':>9} {'p95':>7} {'max':>7} {'reported':>8} {'frames':>6}")
+    for lamp in lamps:
+        if lamp["returncode"] != 0:
+            failures.append(f"lamp {lamp['id']} exited with {lamp['returncode']}")
+        if args.verbose:
+            for line in lamp["log"]:
+                print(f"  lamp {lamp['id']}: {line}")
+
+        start = lamp["clock"][0]["real"] if lamp["clock"] else 0
+        errors = []
+        for record in lamp["clock"]:
+            if record["real"] - start < args.settle * 1e6:
+                continue
+            expected = master_shared(master, record["real"])
+            if expected is not None:
+                errors.append(abs(record["shared"] - expected))
+
+        last = lamp["clock"][-1] if lamp["clock"] else {"role": "-", "jitter_us": 0}
+        if errors:
+            print(f"{lamp['id']:>4} {lamp['offset_us'] / 1e6:>9.3f} {lamp['drift_ppm']:>9} "
+                  f"{last['role']:>9} {statistics.median(errors):>9.0f} "
+                  f"{percentile(errors, 95):>7.0f} {max(errors):>7.0f} "
+                  f"{last['jitter_us']:>8} {len(lamp['frames']):>6}")
+            if percentile(errors, 95) > args.max_error:
+                failures.append(f"lamp {lamp['id']}: sync error {percentile(errors, 95):.0f} us")
+        else:
+            failures.append(f"lamp {lamp['id']}: no clock reports after settling")
+        if not lamp["frames"]:
+            failures.append(f"lamp {lamp['id']}: no scene frames")
+
+    # Real time spread of each frame rendered by every lamp
+    common = set.intersection(*(set(lamp["frames"]) for lamp in lamps))
+    skews = [max(lamp["frames"][f] for lamp in lamps) - min(lamp["frames"][f] for lamp in lamps)
+             for f in sorted(common)]
+    if skews:
+        print(f"\nframe skew over {len(skews)} frames: p50 {statistics.median(skews):.0f} us, "
+              f"p95 {percentile(skews, 95):.0f} us, max {max(skews)} us")
+        if percentile(skews, 95) > args.max_skew:
+            failures.append(f"frame skew {percentile(skews, 95):.0f} us")
+    else:
+        failures.append("no frame rendered by all lamps")
+
+    # After the end no lamp renders scene frames any more
+    end = next((lamp["scene_end"] for lamp in lamps if "scene_end" in lamp), None)
+    if end is not None:
+        late = [max(lamp["frames"].values()) - end for lamp in lamps if lamp["frames"]]
+        print(f"scene end: last scene frame at {max(late) / 1000:+.0f} ms from the end")
+        for lamp in lamps:
+            if lamp["frames"] and max(lamp["frames"].values()) > end + SCENE_END_SLACK:
+                failures.append(f"lamp {lamp['id']}: scene frames after the end")
+    elif args.scene_end_at >= 0:
+        failures.append("the scene was not ended")
+
+    if failures:
+        print("\nFAILED:")
+        for failure in failures:
+            print(f"  {failure}")
+        sys.exit(1)
+    print("\nAll lamps in sync")
+
+
+if __name__ == "__main__":
+    main()